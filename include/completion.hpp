@@ -0,0 +1,48 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#include <pthread.h>
+
+#define COMPLETION_MAX_SLOTS 1024
+#define COMPLETION_NUM_WORDS (COMPLETION_MAX_SLOTS / 64)
+
+
+// Completion notification from session worker threads to the scheduler thread.
+// A worker sets its slot's bit, bumps the slot's sequence number and the epoch, and issues a single
+// futex wake only when the scheduler is asleep, so it never waits on a lock the scheduler holds.
+// Bits stay set until the scheduler takes them: a completion landing between the scheduler's scan
+// and its next wait makes that wait return at once, and every completion that lands while the
+// scheduler sleeps is taken in one wakeup. Without futexes (non-Linux) a mutex and condition
+// variable are used instead, held only around the bit check.
+class CompletionSignal {
+    public:
+    CompletionSignal();
+    ~CompletionSignal();
+
+    // called from worker threads
+    void post(int slot);
+
+    // called from the scheduler thread; 0 once any slot completed, ETIMEDOUT at deadline_ts
+    int wait(int64_t deadline_ts, std::vector<int>& slots);
+    int take(std::vector<int>& slots);
+
+    // getter functions
+    uint32_t get_seq(int slot) { return slot_seqs[slot].load(std::memory_order_acquire); }
+
+
+    private:
+    std::atomic<uint64_t> words[COMPLETION_NUM_WORDS];
+    std::atomic<uint32_t> slot_seqs[COMPLETION_MAX_SLOTS];     // completions posted per slot
+    std::atomic<uint32_t> epoch{0};     // futex word, bumped by every post
+    std::atomic<int> sleeping{0};       // the scheduler is in (or about to enter) futex wait
+
+#ifndef __linux__
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <atomic>
+
+#include <pthread.h>
+
+#define CONFIG_WATCH_POLL_MS 500
+#define CONFIG_WATCH_DEBOUNCE_MS 200    // quiet time after the last write before a change is raised
+#define CONFIG_WATCH_EVENT_BUFFER_SIZE 4096
+
+
+// Watches one config file from a background thread and raises a flag when it is rewritten.
+// Uses inotify on Linux; elsewhere the modification time is polled every CONFIG_WATCH_POLL_MS.
+// The directory is watched rather than the file, since editors usually replace the file on save.
+// Only completed writes and renames count, and a change is raised once the file has been quiet
+// for CONFIG_WATCH_DEBOUNCE_MS, so an editor saving in several steps triggers one reload.
+class ConfigWatcher {
+    public:
+    ConfigWatcher(const std::string& config_path);
+    ~ConfigWatcher();
+
+    void start();
+    void stop();
+
+    // returns 1 once per batch of changes seen since the last call
+    int consume_change() { return std::atomic_exchange(&flag_changed, 0); }
+
+
+    private:
+    static void* watch_func(void* arg);
+    void watch_inotify();
+    void watch_polling();
+
+    std::string config_path;
+    std::string config_dir;
+    std::string config_name;
+
+    pthread_t watch_thread;
+    std::atomic<int> flag_changed{0};
+    std::atomic<int> flag_stop{0};
+    int running = 0;
+
+};
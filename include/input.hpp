@@ -11,5 +11,17 @@
 #include <opencv2/imgproc.hpp>
 
 
+// test-time augmentation: crops are taken in this order, the first one equals the plain preprocess_image input
+#define TTA_MAX_CROPS 8
+#define TTA_CROP_SCALE (256.0 / 224.0)  // the zoomed views crop the input size out of an image resized by this
+
+#define TTA_VIEW_FULL 0
+#define TTA_VIEW_CENTER 1
+#define TTA_VIEW_TOP_LEFT 2
+#define TTA_VIEW_TOP_RIGHT 3
+#define TTA_VIEW_BOTTOM_LEFT 4
+#define TTA_VIEW_BOTTOM_RIGHT 5
+
 cv::Mat preprocess_image(const std::string& image_filepath, const std::vector<int64_t>& input_dims);
 void prepareInputTensor(const std::string& image_filepath, const std::vector<int64_t>& input_dims, std::vector<float>& input_tensor_values, int64_t batch_size, size_t input_tensor_size);
+void prepare_crop_tensor(const std::string& image_filepath, const std::vector<int64_t>& input_dims, std::vector<float>& input_tensor_values, int num_crops);
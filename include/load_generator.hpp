@@ -0,0 +1,87 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#define LOAD_MODE_POISSON 0
+#define LOAD_MODE_BURSTY 1
+#define LOAD_MODE_REPLAY 2
+
+#define LOAD_DEFAULT_BURST_SIZE 4
+#define LOAD_BURST_SPACING_MS 1
+#define LOAD_DEFAULT_TARGET_HIT_RATE 95.0    // percent, for the sustainable rate of a sweep
+
+#define LOAD_OUTCOME_HIT 0
+#define LOAD_OUTCOME_MISS 1        // launched, but a model overran or nothing finished
+#define LOAD_OUTCOME_DROPPED 2     // closed before any model was launched
+
+#define LOAD_LOG_HEADER "# rate_fps\trequest\tstream\tarrival_ms\tqueue_ms\tservice_ms\tresponse_ms\tlaunched\tfinished\toutcome"
+
+
+// One frame request served under generated load; times are relative to its arrival.
+struct LoadRecord {
+    int request_id;
+    int stream_id;
+    int64_t arrival_ts;
+    int64_t queue_ms;       // arrival to the first launch, or to the close if nothing was launched
+    int64_t service_ms;     // first launch to the last finish (or the deadline)
+    int64_t response_ms;    // arrival to the close, at most the deadline
+    int num_launched;
+    int num_finished;
+    int outcome;
+};
+
+struct LoadSummary {
+    int num_requests;
+    int num_hits;
+    int num_dropped;
+    double offered_fps;
+    double queue_p50_ms, queue_p99_ms;
+    double service_p50_ms, service_p99_ms;
+    double response_p50_ms, response_p99_ms;
+};
+
+// Open-loop arrival process of one stream: arrivals do not wait for earlier frames to finish.
+// Poisson draws exponential gaps at rate_fps; bursty draws Poisson burst epochs at
+// rate_fps / burst_size, each delivering burst_size frames LOAD_BURST_SPACING_MS apart;
+// replay returns the recorded offsets as is.
+class LoadGenerator {
+    public:
+    LoadGenerator(int mode, double rate_fps, int burst_size, unsigned int seed);
+
+    // offsets in ms of the given stream, one per line: <offset_ms> [stream_name]
+    int load_replay(const std::string& replay_path, const std::string& stream_name);
+
+    // offset in ms from the start of the run, -1 once a replay is exhausted
+    int64_t next_arrival_ms();
+    void restart(double rate_fps);
+
+    // getter functions
+    int get_mode() { return mode; }
+    double get_rate_fps() { return rate_fps; }
+    int get_num_replayed() { return (int)replay_offsets.size(); }
+
+
+    private:
+    int mode;
+    double rate_fps;
+    int burst_size;
+    std::mt19937 rng;
+
+    double clock_ms = 0.0;
+    int burst_left = 0;
+    int64_t burst_ts = 0;
+    std::vector<int64_t> replay_offsets;
+    size_t replay_cursor = 0;
+
+};
+
+int parse_load_mode(const std::string& mode_name);
+std::vector<double> parse_load_rates(const std::string& rates);
+
+LoadSummary summarize_load(const std::vector<LoadRecord>& records);
+void print_load_summary(const LoadSummary& summary);
+void write_load_records(std::ostream& os, const std::vector<LoadRecord>& records, double rate_fps);
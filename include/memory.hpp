@@ -0,0 +1,54 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <utility>
+#include <atomic>
+
+#include <pthread.h>
+
+#include <onnxruntime/onnxruntime_cxx_api.h>
+
+
+// Owns the ORT memory resources shared between sessions:
+// one prepacked weight container and one read-only mapping per model file, and optionally
+// a capped CPU arena registered in the process-wide environment and used by every session.
+// Lookups are locked since lazily loaded sessions are created from background threads.
+class SessionMemoryManager {
+    public:
+    SessionMemoryManager();
+    ~SessionMemoryManager();
+
+    void enable_shared_arena(size_t arena_limit_bytes);
+    void apply_session_options(Ort::SessionOptions& session_options);
+    void apply_run_options(Ort::RunOptions& run_options);
+
+    Ort::PrepackedWeightsContainer* get_prepacked_weights(const std::string& model_path);
+    const void* map_model(const std::string& model_path, size_t* model_size);
+    void release_model(const std::string& model_path);
+
+    // the next run of any session shrinks the arena, once
+    void request_arena_shrink() { std::atomic_store(&flag_shrink, 1); }
+    int consume_arena_shrink() { return std::atomic_exchange(&flag_shrink, 0); }
+
+    // getter functions
+    int get_shared_arena() { return shared_arena; }
+    size_t get_arena_limit_bytes() { return arena_limit_bytes; }
+    int get_num_prepacked_containers() { return prepacked_weights.size(); }
+
+    // setter functions
+    void set_arena_shrinkage(int arena_shrinkage) { this->arena_shrinkage = arena_shrinkage; }
+
+
+    private:
+    std::map<std::string, Ort::PrepackedWeightsContainer*> prepacked_weights;
+    std::map<std::string, std::pair<void*, size_t>> model_mappings;
+    pthread_mutex_t mutex;
+
+    int shared_arena = 0;
+    size_t arena_limit_bytes = 0;   // 0 means unlimited
+    int arena_shrinkage = 0;
+    std::atomic<int> flag_shrink{0};
+
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#include <pthread.h>
+
+// log-linear buckets: values below 2^HISTOGRAM_SUB_BUCKET_BITS are exact,
+// every power of two above is split into 2^HISTOGRAM_SUB_BUCKET_BITS buckets (12.5% precision)
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_EXPONENT 30
+#define HISTOGRAM_NUM_BUCKETS (HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 2))
+
+#define METRICS_REQUEST_BUFFER_SIZE 1024
+#define METRICS_LISTEN_BACKLOG 4
+#define METRICS_POLL_TIMEOUT_MS 200
+#define METRICS_CLIENT_TIMEOUT_MS 1000     // a silent or stalled client is dropped after this
+
+
+// HDR-style latency histogram; record() is a handful of relaxed atomic ops so it can sit on the hot path.
+class LatencyHistogram {
+    public:
+    LatencyHistogram();
+
+    void record(int64_t value);
+    int64_t quantile(double q);
+
+    // getter functions
+    int64_t get_count() { return count.load(std::memory_order_relaxed); }
+    int64_t get_sum() { return sum.load(std::memory_order_relaxed); }
+
+
+    private:
+    static int bucket_index(int64_t value);
+    static int64_t bucket_upper_bound(int index);
+
+    std::atomic<int64_t> buckets[HISTOGRAM_NUM_BUCKETS];
+    std::atomic<int64_t> count{0};
+    std::atomic<int64_t> sum{0};
+
+};
+
+// Counters of one session, written by the inference thread (or the simulator) and read by the metrics server.
+struct SessionMetrics {
+    std::atomic<int64_t> num_launches{0};
+    std::atomic<int64_t> num_finishes{0};
+    std::atomic<int64_t> num_zombies{0};         // canceled runs that completed after their frame
+    std::atomic<int64_t> num_cancellations{0};   // runs abandoned at a frame boundary
+    std::atomic<int64_t> busy_thread_ms{0};      // run latency times the session's thread count
+    LatencyHistogram latency_ms;
+};
+
+
+// Everything the endpoint exposes. Sessions register their metrics when they are added;
+// rendering takes the lock, the counters themselves never do.
+class MetricsRegistry {
+    public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    void register_session(const std::string& instance_name, const std::string& model_path, SessionMetrics* metrics);
+    void unregister_session(SessionMetrics* metrics);
+    void record_frame(int deadline_hit, int64_t end_ts);
+    std::string render();
+
+    // getter functions
+    int64_t get_num_frames() { return num_frames.load(std::memory_order_relaxed); }
+
+    // setter functions
+    void set_thread_budget(int max_threads) { this->max_threads = max_threads; }
+    void set_threads_in_use(int threads_using) { threads_in_use.store(threads_using, std::memory_order_relaxed); }
+    void set_start_time(int64_t start_ts) { this->start_ts = start_ts; }
+    void enable_thermal() { thermal_enabled = 1; }
+    void set_thermal_state(int thread_budget, double freq_scale, double temp_c) {
+        thermal_thread_budget.store(thread_budget, std::memory_order_relaxed);
+        thermal_freq_scale.store(freq_scale, std::memory_order_relaxed);
+        thermal_temp_c.store(temp_c, std::memory_order_relaxed);
+    }
+
+
+    private:
+    struct SessionEntry {
+        std::string instance_name;
+        std::string model_path;
+        SessionMetrics* metrics;
+    };
+
+    std::vector<SessionEntry> session_entries;
+    pthread_mutex_t mutex;
+
+    std::atomic<int64_t> num_frames{0};
+    std::atomic<int64_t> num_deadline_hits{0};
+    std::atomic<int> threads_in_use{0};
+    std::atomic<int64_t> last_frame_ts{0};
+    int max_threads = 0;
+    int64_t start_ts = 0;
+
+    int thermal_enabled = 0;
+    std::atomic<int> thermal_thread_budget{0};
+    std::atomic<double> thermal_freq_scale{1.0};
+    std::atomic<double> thermal_temp_c{0.0};
+
+};
+
+
+// Serves the registry as Prometheus text on 127.0.0.1:<port> from its own thread.
+class MetricsServer {
+    public:
+    MetricsServer(MetricsRegistry* registry, int port);
+    ~MetricsServer();
+
+    void start();
+    void stop();
+
+
+    private:
+    static void* serve_func(void* arg);
+    void handle_client(int client_fd);
+
+    MetricsRegistry* registry;
+    int port;
+    int listen_fd = -1;
+    pthread_t server_thread;
+    std::atomic<int> flag_stop{0};
+    int running = 0;
+
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+
+struct Prediction {
+    int label_id;
+    float probability;
+};
+
+// Numerically stable softmax over one row of logits (vectorized with NEON or SSE2 when available).
+// A temperature above 1 softens overconfident models (temperature scaling calibration).
+void softmax_stable(const float* logits, float* probs, int num_classes, float temperature = 1.0f);
+// Top-k entries of a row, highest first.
+void select_top_k(const float* probs, int num_classes, int k, std::vector<Prediction>& top_k);
+
+
+// Batched postprocessing of every finished session's logits in one call.
+// Buffers are kept between calls so the per-frame path does not allocate once warmed up.
+class Postprocessor {
+    public:
+    Postprocessor(int top_k);
+    ~Postprocessor();
+
+    // logits[r] points to num_classes values; the ensemble is the weighted mean of the rows' probabilities.
+    // temperatures[r] calibrates row r, missing entries default to 1.
+    void process(
+        const std::vector<const float*>& logits, const std::vector<float>& weights, int num_classes,
+        const std::vector<float>& temperatures = std::vector<float>()
+    );
+
+    // getter functions
+    int get_num_rows() { return num_rows; }
+    const float* get_probabilities(int row) { return probs.data() + (size_t)row * num_classes; }
+    const std::vector<Prediction>& get_top_k(int row) { return row_top_k[row]; }
+    const std::vector<Prediction>& get_ensemble_top_k() { return ensemble_top_k; }
+
+
+    private:
+    int top_k;
+    int num_rows = 0;
+    int num_classes = 0;
+
+    std::vector<float> probs;
+    std::vector<float> ensemble_probs;
+    std::vector<std::vector<Prediction>> row_top_k;
+    std::vector<Prediction> ensemble_top_k;
+
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include <pthread.h>
+
+#define PROFILE_STORE_MAGIC "RDNNPRF"
+#define PROFILE_STORE_VERSION 2
+#define PROFILE_STORE_PATH_LEN 160
+#define PROFILE_STORE_CPU_LEN 64
+#define PROFILE_STORE_MAX_POLICIES 4
+
+
+// One point of a model's latency curve: the benchmark of one thread config on one CPU model.
+// Fixed size, so the file is an array that is used in place from the mapping.
+struct ProfileRecord {
+    uint64_t model_hash;        // of the file contents, so a changed model is profiled again
+    uint64_t cpu_hash;
+    int32_t num_intra_threads;
+    int32_t num_inter_threads;
+    int32_t num_crops;
+    int32_t num_runs;
+    float latency_ms;           // mean of the benchmark runs
+    int32_t num_policies;       // of ref_freqs_khz, 0 when measured without a thermal monitor
+    int32_t ref_freqs_khz[PROFILE_STORE_MAX_POLICIES];  // cpufreq caps the runs were measured at
+    int64_t warmup_bytes;       // resident memory grown by the warmup runs
+    int64_t profiled_at;        // unix time
+    char model_path[PROFILE_STORE_PATH_LEN];    // for inspection, not part of the key
+    char cpu_model[PROFILE_STORE_CPU_LEN];
+};
+
+struct ProfileStoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_records;
+    uint32_t reserved;
+};
+
+// Benchmark results kept across runs, keyed by model hash, thread config and CPU model.
+// The store file is mapped read-only at load; new records are kept in memory until save(),
+// which writes a new file next to the store and renames it over, so a reader never sees a
+// partial file. A file of another version or record size is ignored and rewritten on save.
+// Model hashes are cached under a lock, so that a load thread can hash its model with prepare().
+class ProfileStore {
+    public:
+    ProfileStore(const std::string& store_path);
+    ~ProfileStore();
+
+    int load();
+    int save();
+
+    void prepare(const std::string& model_path) { model_hash(model_path); }
+    const ProfileRecord* find(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops);
+    const ProfileRecord* lookup(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops);
+    void put(
+        const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops,
+        float latency_ms, int num_runs, int64_t warmup_bytes, const std::vector<int64_t>& ref_freqs_khz
+    );
+
+    // getter functions
+    std::string get_store_path() { return store_path; }
+    std::string get_cpu_model() { return cpu_model; }
+    int get_num_records() { return (int)(num_mapped_records + new_records.size()); }
+    int get_num_hits() { return num_hits; }
+    int get_num_misses() { return num_misses; }
+
+
+    private:
+    std::string store_path;
+    std::string cpu_model;
+    uint64_t cpu_hash;
+
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    const ProfileRecord* mapped_records = nullptr;
+    uint32_t num_mapped_records = 0;
+
+    std::vector<ProfileRecord> new_records;
+    std::map<std::string, uint64_t> model_hashes;   // by path, models are hashed once per run
+    pthread_mutex_t mutex;
+    int num_hits = 0;
+    int num_misses = 0;
+
+    uint64_t model_hash(const std::string& model_path);
+    const ProfileRecord* find_record(uint64_t hash, int num_intra_threads, int num_inter_threads, int num_crops);
+    void unmap();
+
+};
+
+std::string read_cpu_model();
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#define PROFILE_DEFAULT_TOP_N 10
+#define PROFILE_TSV_HEADER "# kind\tmodel\tintra\tinter\tname\top_type\tcalls_per_run\tus_per_run\tshare"
+
+
+struct OperatorStat {
+    std::string name;
+    std::string op_type;
+    int64_t total_us;
+    int64_t num_calls;
+};
+
+// Per-operator summary of an ORT profiling trace (chrome://tracing JSON).
+// Node kernel times are attributed to the model_run they fall into; only the last runs are
+// counted, so warmup and load runs do not skew the figures. Everything is reported per run.
+class OperatorProfile {
+    public:
+    OperatorProfile() {}
+
+    // num_last_runs <= 0 counts every run
+    int load(const std::string& trace_path, int num_last_runs);
+
+    void print_top(int top_n);
+    // rows in name order, so reports of two runs can be compared with diff
+    void write_tsv(std::ostream& os, const std::string& model_path, int num_intra_threads, int num_inter_threads);
+
+    // getter functions
+    int get_num_runs() { return num_runs; }
+    double get_run_us() { return num_runs > 0 ? (double)total_run_us / num_runs : 0.0; }
+
+
+    private:
+    int num_runs = 0;
+    int64_t total_run_us = 0;
+    std::map<std::string, OperatorStat> op_types;
+    std::map<std::string, OperatorStat> nodes;
+
+};
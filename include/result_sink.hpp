@@ -0,0 +1,132 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+
+#include <pthread.h>
+
+#define RESULT_MAX_POOLS 32
+#define RESULT_TOP_K 5
+#define RESULT_RING_CAPACITY 4096
+#define RESULT_SINK_POLL_US 2000
+
+#define RESULT_FORMAT_JSONL 0
+#define RESULT_FORMAT_BINARY 1
+
+#define RESULT_BINARY_MAGIC "RDNNRES"
+#define RESULT_BINARY_VERSION 2
+
+
+// One frame, fixed size so it can be copied through the ring and dumped as is.
+// Pools (config lines) past RESULT_MAX_POOLS are left out of the masks and latencies.
+struct FrameRecord {
+    int32_t frame_id;
+    int32_t stream_id;
+    int64_t start_ts;
+    int64_t end_ts;
+    int64_t deadline_ts;
+    int32_t num_launched;
+    int32_t num_finished;
+    uint32_t finished_pool_mask;
+    uint32_t missed_pool_mask;          // expected pools that did not finish by the deadline
+    uint32_t aged_pool_mask;            // finished pools whose result was started in an earlier frame
+    int32_t pool_frame_age[RESULT_MAX_POOLS];
+    int32_t pool_latency_ms[RESULT_MAX_POOLS];  // -1 unless finished
+    int32_t num_predictions;
+    int32_t label_ids[RESULT_TOP_K];
+    float probabilities[RESULT_TOP_K];
+};
+
+struct ResultFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+
+// Bounded single-producer single-consumer queue; neither side ever blocks.
+template <typename T>
+class SpscRing {
+    public:
+    SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    bool try_push(const T& item) {
+        size_t tail = tail_pos.load(std::memory_order_relaxed);
+        if (tail - head_pos.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        slots[tail & mask] = item;
+        tail_pos.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& item) {
+        size_t head = head_pos.load(std::memory_order_relaxed);
+        if (head == tail_pos.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[head & mask];
+        head_pos.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+
+    private:
+    std::vector<T> slots;
+    size_t mask;
+
+    // producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head_pos{0};
+    alignas(64) std::atomic<size_t> tail_pos{0};
+
+};
+
+
+// Asynchronous per-frame result log.
+// The scheduler thread only copies a record into the ring; a background thread formats and writes it.
+// When the writer falls behind the record is dropped and counted instead of stalling the frame loop.
+class ResultSink {
+    public:
+    ResultSink(const std::string& log_path, int format, const std::vector<std::string>& labels);
+    ~ResultSink();
+
+    void push(const FrameRecord& record);
+    void close();
+
+    // getter functions
+    std::string get_log_path() { return log_path; }
+    int64_t get_num_written() { return num_written; }
+    int64_t get_num_dropped() { return std::atomic_load(&num_dropped); }
+
+
+    private:
+    static void* writer_func(void* arg);
+    void write_record(const FrameRecord& record);
+
+    std::string log_path;
+    int format;
+    std::vector<std::string> labels;
+    FILE* log_file = nullptr;
+
+    SpscRing<FrameRecord> ring{RESULT_RING_CAPACITY};
+    pthread_t writer_thread;
+    std::atomic<int> flag_stop{0};
+    int closed = 0;
+
+    int64_t num_written = 0;
+    std::atomic<int64_t> num_dropped{0};
+
+};
+
+int parse_result_format(const std::string& format_name);
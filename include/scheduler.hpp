@@ -7,8 +7,98 @@
 #include <fstream>
 #include <sstream>
 #include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <numeric>
 
 #include "session.hpp"
+#include "simulator.hpp"
+#include "memory.hpp"
+#include "postprocess.hpp"
+#include "result_sink.hpp"
+#include "metrics.hpp"
+#include "thermal.hpp"
+#include "profiler.hpp"
+#include "load_generator.hpp"
+#include "profile_store.hpp"
+
+#define SCHEDULER_TOP_K 5
+
+struct FrameStats {
+    int64_t start_ts;
+    int64_t end_ts;
+    int64_t deadline_ts;
+    int num_launched;
+    int num_finished;
+    int stream_id;
+    int num_aged;   // results of earlier frames' spanning runs used by this frame
+};
+
+struct StreamInfo {
+    std::string name;
+    int64_t deadline_ms;
+    std::vector<int> pool_idxs;
+    std::vector<int> input_slots;   // input slot of each pool in pool_idxs, same for all replicas
+};
+
+struct FrameRequest {
+    int request_id;
+    int stream_id;
+    int64_t arrival_ts;
+    int64_t deadline_ts;
+    std::vector<int> pending;       // index into the stream's pool_idxs
+    int num_launched;
+    int num_running;
+    int num_finished;
+    std::vector<int> finished_sessions;
+    std::vector<int64_t> finished_latencies;
+    std::vector<int> logit_sessions;    // sessions whose logits are in finished_logits
+    std::vector<float> finished_logits;    // copied at collection, the session may run again before the request closes
+    int64_t first_launch_ts = -1;
+    int64_t last_finish_ts = -1;
+};
+
+#define CASCADE_DEFAULT_THRESHOLD 0.8
+
+// One model line of a config file: <model_path> <weight> <intra> <inter> [key=value...]
+struct SessionConfig {
+    std::string model_path;
+    float weight;
+    int num_intra_threads;
+    int num_inter_threads;
+    int num_replicas;
+    float temperature;
+    float threshold;
+    int num_crops;          // test-time augmentation views per run, see TTA_MAX_CROPS
+};
+
+struct CascadeFrame {
+    int exit_stage;         // last stage run, -1 if none finished
+    int num_stages;         // stages launched
+    int64_t compute_ms;     // sum of the stage latencies
+    int64_t thread_ms;      // stage latencies times their thread counts
+    int64_t budget_ms;
+    int label_id;           // prediction of the exit stage, -1 if none
+    float confidence;
+};
+
+// Result of a run that spanned frame boundaries, consumed by a later frame than the one it started in.
+struct AgedResult {
+    int session_idx;
+    int frame_age;          // frames elapsed since the launch
+    int64_t latency_ms;     // launch to finish
+    int logit_row;          // row in aged_logits, -1 without output
+};
+
+struct FrameResult {
+    int stream_id;
+    std::vector<int> session_idxs;
+    std::vector<int> session_frame_ages;
+    std::vector<std::vector<Prediction>> session_top_k;
+    std::vector<Prediction> ensemble_top_k;
+};
 
 
 class InferenceScheduler {
@@ -16,11 +106,26 @@ class InferenceScheduler {
     InferenceScheduler(const std::string& label_path, int max_threads);
     ~InferenceScheduler();
 
+    void attach_simulator(SchedulerSimulator* simulator);
+    void attach_result_sink(ResultSink* result_sink);
+    void attach_thermal_monitor(ThermalMonitor* thermal_monitor, double guard_c);
+    void attach_profile_store(ProfileStore* profile_store);
+    void record_trace(const std::string& trace_path);
+    void save_trace();
+    void configure_memory(int64_t arena_limit_mb, int arena_shrinkage);
+    void configure_loading(int lazy_loading, int64_t memory_budget_mb);
+    void configure_spanning(int max_frame_age);
+    void configure_cascade(int cascade, int ground_truth_id);
+    void configure_profiling(const std::string& profile_path, int top_n);
+    void print_memory_report();
+
     void add_session(
         const std::string& model_path, float weight,
-        int num_intra_threads, int num_inter_threads
+        int num_intra_threads, int num_inter_threads,
+        int num_replicas = 1
     );
     void load_session_config(const std::string& config_path);
+    void reload_session_config(const std::string& config_path);
 
     void load_input(const std::string& image_path, int batch_size);
     void print_results();
@@ -32,8 +137,33 @@ class InferenceScheduler {
     void reset_inference();
     void enqueue_inference_naive();
 
+    // multi-stream serving
+    int add_stream(
+        const std::string& name, const std::string& image_path,
+        int64_t deadline_ms, const std::vector<int>& pool_idxs
+    );
+    void submit_frame(int stream_id, int64_t arrival_ts);
+    void serve_requests(int64_t until_ts);
+    void serve_streams(int num_frames);
+    void serve_load(const std::vector<LoadGenerator*>& generators, int num_frames);
+
+    int64_t get_current_time();
+    void sleep_until(int64_t timestamp);
+    void print_frame_summary();
+    void print_cascade_summary();
+
     // getter functions
-    std::vector<InferenceSession*> get_sessions() { return sessions; }
+    std::vector<InferenceSession*> get_sessions() { return sessions; }   // null for freed slots
+    std::vector<StreamInfo> get_streams() { return streams; }
+    std::vector<FrameStats> get_frame_stats() { return frame_stats; }
+    const FrameResult& get_frame_result() { return frame_result; }
+    // sessions finished in the current frame, until reset_inference()
+    std::vector<int> get_finished_sessions() { return session_finished_queue; }
+    MetricsRegistry* get_metrics_registry() { return &metrics_registry; }
+    const std::vector<LoadRecord>& get_load_records() { return load_records; }
+
+    // setter functions
+    void set_verbose(int verbose) { this->verbose = verbose; }
 
 
     private:
@@ -41,19 +171,150 @@ class InferenceScheduler {
     std::vector<std::string> labels;
 
     int max_threads;
+    int thread_budget;      // max_threads, lowered by the thermal guard
     int threads_using = 0;
 
     std::vector<InferenceSession*> sessions;
     std::vector<float> session_weights;
     std::vector<int64_t> session_inference_times;
     float lagging;
+    float expected_latency(int session_idx);
+    void update_lagging(int session_idx, int64_t latency);
 
     std::vector<int> session_unready_queue;
     std::vector<int> session_ready_queue;
     std::vector<int> session_inference_queue;
     std::vector<int> session_finished_queue;
+    std::vector<int> session_spare_queue;    // idle replicas of pools already served this frame
+
+    // replica pools: replicas of one config line
+    std::vector<std::vector<int>> pool_sessions;
+    std::vector<int> session_pools;
+
+    SessionMemoryManager memory_manager;
+    std::vector<int64_t> session_warmup_bytes;   // resident memory grown by the benchmark warmup
+
+    // operator profiling: the first replica of each pool runs the benchmark under the ORT
+    // profiler; the traces are summarized into profile_path once the benchmark is done
+    std::string profile_path;
+    int profile_top_n = PROFILE_DEFAULT_TOP_N;
+    int profiles_reported = 0;
+    void report_operator_profiles(int num_runs);
+
+    // benchmark results of earlier runs; only new or changed models are benchmarked
+    ProfileStore* profile_store = nullptr;
+
+    // lazy loading: sessions are loaded on first use and evicted least recently used first
+    int lazy_loading = 0;
+    int64_t memory_budget_bytes = 0;    // 0 means unlimited
+    int loading_session = -1;
+    int usage_clock = 0;
+    std::vector<int> session_profiled;
+    std::vector<int> session_num_launches;
+    std::vector<int> session_last_used;
+
+    // hot reload: removed pools are retired and their sessions deleted once drained, leaving a null
+    // slot that the next added session reuses; a retired pool without sessions left is reused by the
+    // next added pool. New sessions load in the background before joining.
+    std::vector<SessionConfig> pool_configs;
+    std::vector<int> pool_retired;
+    std::vector<int> pool_successors;   // pool taking over once loaded (thread change), -1 if none
+    std::vector<int> session_pending_queue;
+    std::vector<int> free_session_slots;
+    std::string input_image_path;
+    int input_batch_size = 0;
+    void apply_pending_sessions();
+    void drain_retired_sessions();
+    int is_retired(int session_idx) { return pool_retired[session_pools[session_idx]]; }
+
+    // spanning: models longer than the frame may finish up to max_frame_age frames late,
+    // their result then joins the frame in which it arrives
+    int max_frame_age = 0;
+    int frame_index = 0;
+    std::vector<int> session_span_queue;
+    std::vector<int> session_launch_frames;
+    std::vector<int64_t> session_span_deadlines;
+    std::vector<AgedResult> aged_results;
+    std::vector<float> aged_logits;
+
+    // cascade: pools are stages in config order; a frame escalates to the next stage
+    // only while the calibrated confidence of the last stage stays below its threshold
+    int cascade = 0;
+    int ground_truth_id = -1;   // label of the input, -1 if unknown
+    std::vector<float> pool_temperatures;
+    std::vector<float> pool_thresholds;
+    std::vector<int> pool_order;        // active pools in config order
+    std::vector<CascadeFrame> cascade_frames;
+    std::vector<float> stage_probs;
+    void infer_cascade(int64_t deadline_ts);
+
+    // thermal: benchmark latencies are scaled by the frequency drop since the benchmark,
+    // and the thread budget shrinks as the device nears its throttling point
+    ThermalMonitor* thermal_monitor = nullptr;
+    double thermal_guard_c = THERMAL_DEFAULT_GUARD_C;
+    int64_t thermal_sample_ts = -1;
+    float freq_scale = 1.0;
+    int thermal_frames_reduced = 0;
+    float thermal_max_freq_scale = 1.0;
+    double thermal_max_temp_c = 0.0;
+    void update_thermal_state();
+
+    // session slots are session indices; completions are posted by the worker threads
+    CompletionSignal completion_signal;
+    std::vector<int> completed_slots;
+
+    int wait_any_finished(int64_t deadline_ts);
+    int wait_session_finished(int session_idx, uint32_t launch_seq, int64_t deadline_ts);
+    void trace_latency(int session_idx);
+    void balance_replicas();
+    int find_idle_replica(int pool_idx);
+    int add_pool(const SessionConfig& config, int lazy_load);
+    int session_available(int session_idx);
+    void mark_session_used(int session_idx);
+    void evict_sessions();
+    void release_unused_model(const std::string& model_path);
+    void collect_span_sessions();
+    int span_sessions_due(int64_t deadline_ts);
+
+    void collect_stream_sessions();
+    void launch_stream_sessions();
+    void close_request(int request_pos);
+    void postprocess_frame(
+        int stream_id, const std::vector<int>& session_idxs,
+        const std::vector<const float*>& logits, const std::vector<int>& frame_ages
+    );
+    void emit_frame_record(
+        const FrameStats& stats, const std::vector<int>& pool_idxs,
+        const std::vector<int>& finished_sessions, const std::vector<int64_t>& finished_latencies,
+        const std::vector<AgedResult>& aged
+    );
+
+    SchedulerSimulator* simulator = nullptr;
+    int verbose = 1;
+
+    std::vector<FrameStats> frame_stats;
+    Postprocessor postprocessor{SCHEDULER_TOP_K};
+    FrameResult frame_result;
+    std::vector<float> frame_weights;
+    std::vector<float> frame_temperatures;
+
+    ResultSink* result_sink = nullptr;
+    int next_frame_id = 0;
+
+    MetricsRegistry metrics_registry;
+    void push_frame_stats(const FrameStats& stats);
+    std::vector<int64_t> session_launch_times;
+
+    std::string trace_path;
+    std::vector<std::vector<int64_t>> session_latency_traces;
+
+    std::vector<StreamInfo> streams;
+    std::vector<FrameRequest> active_requests;
+    std::vector<int> session_owners;    // request_id of the running stream inference, -1 if none
+    int next_request_id = 0;
+    std::vector<LoadRecord> load_records;   // requests closed during the last serve_load
+    int serving_load = 0;
 
-    pthread_mutex_t any_finished_mutex;
-    pthread_cond_t any_finished_cond;
+};
 
-};
\ No newline at end of file
+int parse_session_config(const std::string& config_path, std::vector<SessionConfig>& configs);
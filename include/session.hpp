@@ -9,24 +9,45 @@
 
 #include <onnxruntime/onnxruntime_cxx_api.h>
 
+#include "metrics.hpp"
+#include "completion.hpp"
+
 #define SESSION_STATE_IDLE 0
 #define SESSION_STATE_INFER 1
 #define SESSION_STATE_FINISHED 2
 #define SESSION_STATE_ZOMBIE 3
 
+#define SESSION_LOAD_UNLOADED 0
+#define SESSION_LOAD_LOADING 1
+#define SESSION_LOAD_LOADED 2
+
+#define SESSION_NUM_WARMUP_RUNS 2
+
+class SchedulerSimulator;
+class SessionMemoryManager;
+class ProfileStore;
 
 class InferenceSession {
     public:
     InferenceSession(
         std::string instance_name,
         const std::string& model_path, const std::string& label_path,
-        int num_intra_threads, int num_inter_threads
+        int num_intra_threads, int num_inter_threads,
+        SchedulerSimulator* simulator = nullptr,
+        SessionMemoryManager* memory_manager = nullptr,
+        int lazy_load = 0,
+        int num_crops = 1
     );
     ~InferenceSession();
 
     void print_info();
 
+    void load_model(int num_warmup_runs);
+    int load_model_async();
+    int unload_model();
+
     void load_input(const std::string& image_path, int batch_size);
+    int add_input(const std::string& image_path);
     void print_results();
 
     void session_run();
@@ -34,28 +55,51 @@ class InferenceSession {
     void infer_sync();
     int infer_async();
     void wait_infer();
-    void add_finish_listener(pthread_mutex_t *mutex, pthread_cond_t *cond);
-    void notify_finish_listeners();
+    void enable_profiling(const std::string& profile_prefix);
+    std::string end_profiling();
+    void attach_completion_signal(CompletionSignal* completion_signal, int completion_slot);
+    void attach_profile_store(ProfileStore* profile_store) { this->profile_store = profile_store; }
+    void notify_completion();
 
     void reset_state();
+    void record_run_end(int64_t finish_time_ts, int canceled);
 
     // getter functions
     std::vector<float> get_output_tensor_values() { return output_tensor_values; }
+    // one row of logits per image; with crops, the mean over the image's crops
+    const float* get_output_data() {
+        const std::vector<float>& values = num_crops > 1 ? merged_output_values : output_tensor_values;
+        return values.empty() ? nullptr : values.data();
+    }
     std::vector<std::string> get_labels() { return labels; }
     std::string get_instance_name() { return instance_name; }
     std::string get_model_path() { return model_path; }
     std::string get_label_path() { return label_path; }
     int get_num_intra_threads() { return num_intra_threads; }
     int get_num_inter_threads() { return num_inter_threads; }
+    int get_num_crops() { return num_crops; }
     pthread_t get_thread() { return thread; }
     int get_state() { return state; }
     int64_t get_finish_time() { return finish_time_ts; }
     int get_num_inferenced() { return num_inferenced; }
+    int get_load_state() { return std::atomic_load(&load_state); }
+    int is_loaded() { return std::atomic_load(&load_state) == SESSION_LOAD_LOADED; }
+    int get_flag_infer() { return std::atomic_load(&flag_infer); }
+    int has_workers() { return std::atomic_load(&num_workers) > 0; }
+    float get_warm_latency() { return warm_latency_ms; }
+    int64_t get_resident_bytes() { return resident_bytes; }
+    SessionMetrics* get_metrics() { return &metrics; }
 
     // setter functions
     void set_state(int state) { this->state = state; }
     void set_flag_infer(int flag_value) { atomic_store(&flag_infer, flag_value); }
     void set_finish_time(int64_t finish_time) { this->finish_time_ts = finish_time; }
+    void select_input(int input_slot) { this->input_slot = input_slot; }
+
+    // a load or inference thread leaves as its very last access, after notify_completion();
+    // the session may be deleted only once none is left
+    void enter_worker() { std::atomic_fetch_add(&num_workers, 1); }
+    void leave_worker() { std::atomic_fetch_sub(&num_workers, 1); }
 
 
     private:
@@ -64,31 +108,63 @@ class InferenceSession {
     std::string label_path;
     int num_intra_threads;
     int num_inter_threads;
+    int num_crops;          // test-time augmentation views batched into each run
     std::vector<std::string> labels;
     
     Ort::Session* session = nullptr;
+    Ort::RunOptions run_options{nullptr};
+    Ort::RunOptions shrink_run_options{nullptr};    // run_options plus arena shrinkage, used once per request
+    SchedulerSimulator* simulator = nullptr;    // runs are simulated instead of executed
+    SessionMemoryManager* memory_manager = nullptr;
+    ProfileStore* profile_store = nullptr;      // the model is hashed for it on load
+    std::atomic_int load_state;
+    float warm_latency_ms = 0.0;
+    int64_t resident_bytes = 0;
+    std::string profile_prefix;     // ORT per-node profiling, empty when off
+
+    // inputs are recorded so that an unloaded session can prepare them again on load
+    std::string input_image_path;
+    int input_batch_size = 0;
+    std::vector<std::string> extra_input_image_paths;
+    void prepare_io();
+    int prepare_extra_input(const std::string& image_path);
+    void fill_input(const std::string& image_path, std::vector<float>& values);
+    void merge_crops();
+    Ort::RunOptions& next_run_options();
+
     std::vector<const char*> input_names;
     std::vector<const char*> output_names;
     std::vector<Ort::Value> input_tensors;
     std::vector<Ort::Value> output_tensors;
     std::vector<float> input_tensor_values;
     std::vector<float> output_tensor_values;
+    std::vector<float> merged_output_values;
+    std::vector<int64_t> input_dims;
+    std::vector<std::vector<float>> extra_input_tensor_values;     // inputs of additional streams
+    int input_slot = 0;
 
     std::vector<Ort::AllocatedStringPtr> input_node_name_allocated_strings;
     std::vector<Ort::AllocatedStringPtr> output_node_name_allocated_strings;
 
     pthread_t thread;
+    pthread_t load_thread;
     pthread_attr_t attr;
-    std::vector<pthread_mutex_t *> finish_listeners_mutex;
-    std::vector<pthread_cond_t *> finish_listeners_cond;
+    CompletionSignal* completion_signal = nullptr;
+    int completion_slot = -1;
     int64_t finish_time_ts;
 
     int state;
     std::atomic_int flag_infer;     // indicates real state of inference
+    std::atomic_int num_workers{0}; // detached threads still using the session
     int num_inferenced = 0;
 
+    SessionMetrics metrics;
+    int64_t launch_time_ts = -1;    // set by infer_async() only, so benchmark runs are not counted
+
 };
 
+Ort::Env& get_ort_env();
+
 void test_single_session(
     const std::string& model_filepath, const std::string& label_filepath, const std::string& image_filepath,
     int num_intra_threads, int num_inter_threads,
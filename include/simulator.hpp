@@ -0,0 +1,85 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <random>
+#include <fstream>
+#include <sstream>
+
+class InferenceSession;
+
+
+// Latency distribution of one (model, thread config) pair.
+// Recorded samples are replayed in order; otherwise a normal distribution is sampled.
+class LatencyModel {
+    public:
+    LatencyModel() {}
+    LatencyModel(const std::vector<float>& samples);
+    LatencyModel(float mean_ms, float stddev_ms);
+
+    float sample(std::mt19937& rng);
+    float expected();
+    LatencyModel scaled(float factor);
+
+    private:
+    std::vector<float> samples;
+    size_t cursor = 0;
+    float mean_ms = 0.0;
+    float stddev_ms = 0.0;
+
+};
+
+// Discrete-event backend for InferenceScheduler.
+// Sessions attached to a simulator never run ORT; their runs are finish events on a virtual clock.
+class SchedulerSimulator {
+    public:
+    SchedulerSimulator(const std::string& trace_path, unsigned int seed);
+    ~SchedulerSimulator();
+
+    void load_trace(const std::string& trace_path);
+
+    float get_expected_latency(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops = 1);
+    // traced as is, without falling back to another thread config
+    int has_latency_model(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops = 1);
+
+    int64_t launch(InferenceSession* session);
+    void advance_to(int64_t timestamp);
+    int wait_any_finished(int64_t deadline_ts);
+
+    // getter functions
+    int64_t get_current_time() { return now_ts; }
+    int get_num_running() { return (int)events.size(); }
+    // canceled runs keep their event until it is due, so a session may have several
+    int has_pending_event(InferenceSession* session) { return pending_events.count(session) > 0; }
+
+
+    private:
+    struct FinishEvent {
+        int64_t finish_ts;
+        uint64_t seq;
+        InferenceSession* session;
+        int inference_id;
+
+        bool operator>(const FinishEvent& other) const {
+            if (finish_ts != other.finish_ts) return finish_ts > other.finish_ts;
+            return seq > other.seq;
+        }
+    };
+
+    LatencyModel& find_latency_model(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops);
+    int process_event(const FinishEvent& event);
+
+    std::map<std::string, LatencyModel> latency_models;
+    std::priority_queue<FinishEvent, std::vector<FinishEvent>, std::greater<FinishEvent>> events;
+    std::map<InferenceSession*, int> pending_events;     // events still queued per session
+    uint64_t next_seq = 0;
+
+    int64_t now_ts = 0;
+    std::mt19937 rng;
+
+};
+
+std::string latency_model_key(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops = 1);
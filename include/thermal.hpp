@@ -0,0 +1,53 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#define THERMAL_SYSFS_ROOT "/sys"
+#define THERMAL_DEFAULT_GUARD_C 5.0
+#define THERMAL_DEFAULT_TRIP_C 80.0     // Raspberry Pi firmware throttling point, used when no passive trip is exposed
+#define THERMAL_SAMPLE_INTERVAL_MS 200
+#define THERMAL_MAX_ZONES 16
+
+
+struct ThermalState {
+    double freq_scale;      // reference cap / current cap, worst cpufreq policy running the sessions
+    double temp_c;          // hottest thermal zone
+    double headroom_c;      // smallest distance to a zone's throttling trip point
+};
+
+// Reads cpufreq policies and thermal zones from sysfs.
+// The frequency scale compares scaling_max_freq, the cap lowered by cooling devices and power
+// limits, rather than the instantaneous frequency, which also dips on idle clusters and under
+// DVFS. Only the policies of the CPUs the process may run on are read.
+// Files are opened once and re-read with pread, so a sample costs a few syscalls.
+// Missing files are tolerated: without cpufreq the scale stays 1, without thermal zones the headroom is unbounded.
+class ThermalMonitor {
+    public:
+    ThermalMonitor(const std::string& sysfs_root = THERMAL_SYSFS_ROOT);
+    ~ThermalMonitor();
+
+    ThermalState sample();
+
+    // current caps become the ones benchmark latencies were measured at
+    void mark_reference();
+    // caps stored with the latencies of an earlier run; ignored if the policies differ
+    void set_reference(const std::vector<int64_t>& freqs_khz);
+    std::vector<int64_t> read_freqs();
+
+    // getter functions
+    int get_num_policies() { return (int)policy_fds.size(); }
+    int get_num_zones() { return (int)zone_fds.size(); }
+
+
+    private:
+    static int64_t read_value(int fd);
+
+    std::vector<int> policy_fds;            // scaling_max_freq, kHz
+    std::vector<int64_t> reference_freqs;
+    std::vector<int> zone_fds;              // temp, millidegrees Celsius
+    std::vector<int64_t> zone_trips;        // lowest passive trip, millidegrees Celsius
+
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+class SchedulerSimulator;
+
+#define TUNE_DEFAULT_TARGET_HIT_RATE 95.0     // percent of frames
+#define TUNE_NUM_FRAMES 1000                  // simulated frames per evaluated ensemble
+#define TUNE_MIN_GAIN 0.01                    // accuracy points a move must add
+#define TUNE_NUM_VALIDATION_FRAMES 300        // real frames served to validate the chosen ensemble
+#define TUNE_NUM_VALIDATION_RUNS 10           // benchmark runs per member before validation
+
+
+// One model at one thread config, with its accuracy from the config comments.
+struct TuneCandidate {
+    std::string model_path;
+    float accuracy;         // percent, top-1
+    int num_intra_threads;
+    int num_inter_threads;
+    float latency_ms;       // expected, from the latency trace
+};
+
+struct TuneResult {
+    double accuracy;        // expected per frame, 0 for frames without results
+    double hit_rate;        // percent of frames
+    int64_t thread_ms;      // thread time per frame, to break ties
+};
+
+// Searches the ensemble and thread assignment with the best expected accuracy that keeps the
+// deadline hit rate at or above a target, on the simulator.
+// Accuracies come from the "# <model_path> (<accuracy>%, ...)" comments of a config. Every model
+// is profiled at power-of-two thread widths (or taken from an existing latency trace); candidates
+// slower and less accurate than another at the same width are pruned. The search then greedily
+// adds a model or changes a member's width, simulating every move, until no move adds accuracy.
+// A frame is credited with the best accuracy among its finished models, plus ensemble_gain
+// points per additional finished model (0 unless measured for the model set).
+// The simulator runs every model as if it were alone, so the simulated figures are contention-free
+// estimates. When the candidates were profiled on this machine, the chosen ensemble is served on
+// the real models, and the search backs off step by step until the measured hit rate holds.
+class EnsembleTuner {
+    public:
+    EnsembleTuner(const std::string& label_path, int max_threads, unsigned int seed);
+
+    int load_accuracies(const std::string& config_path);
+    void profile(const std::string& image_path, const std::string& trace_path, int num_runs);
+    void use_trace(const std::string& trace_path);
+
+    void search(int64_t deadline_ms, double target_hit_rate, double ensemble_gain);
+    void validate();
+    int write_config(const std::string& output_path, int64_t deadline_ms, int num_tests);
+
+    // getter functions
+    std::vector<TuneCandidate> get_ensemble() { return ensemble; }
+    TuneResult get_result() { return result; }
+
+
+    private:
+    std::string label_path;
+    int max_threads;
+    unsigned int seed;
+
+    std::vector<std::string> model_paths;       // config comment order
+    std::map<std::string, float> accuracies;
+    std::string trace_path;
+    std::string image_path;                     // set when profiled here, the real models can then be served
+    std::vector<TuneCandidate> candidates;      // every traced model/thread pair
+    std::vector<TuneCandidate> front;           // the Pareto-optimal ones, searched
+
+    int64_t deadline_ms = 0;
+    double target_hit_rate = TUNE_DEFAULT_TARGET_HIT_RATE;
+    double ensemble_gain = 0.0;
+    std::vector<TuneCandidate> ensemble;
+    TuneResult result{0.0, 0.0, 0};
+    std::vector<std::vector<TuneCandidate>> step_ensembles;    // accepted search steps, to back off to
+    std::vector<TuneResult> step_results;
+    int validated = 0;
+    TuneResult measured{0.0, 0.0, 0};
+
+    void prune_candidates();
+    TuneResult serve(const std::vector<TuneCandidate>& members, SchedulerSimulator* simulator, int num_frames);
+    TuneResult simulate(const std::vector<TuneCandidate>& members);
+    int better(const TuneResult& a, const TuneResult& b);
+
+};
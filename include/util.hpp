@@ -35,4 +35,6 @@ void print_inference_results(const std::vector<float>& outputTensorValues, const
 
 struct timespec timepoint_to_timespec(int64_t timepoint);
 
-int64_t get_current_time_milliseconds();
\ No newline at end of file
+int64_t get_current_time_milliseconds();
+int64_t get_resident_memory_bytes();
+void release_free_heap();
\ No newline at end of file
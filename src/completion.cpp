@@ -0,0 +1,113 @@
+#include "completion.hpp"
+#include "util.hpp"
+
+#include <cerrno>
+#include <climits>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef __linux__
+static int futex_wait(std::atomic<uint32_t>* word, uint32_t expected, int64_t timeout_ms) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+    return syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+
+CompletionSignal::CompletionSignal() {
+    for (int i = 0; i < COMPLETION_NUM_WORDS; i++) {
+        words[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < COMPLETION_MAX_SLOTS; i++) {
+        slot_seqs[i].store(0, std::memory_order_relaxed);
+    }
+#ifndef __linux__
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+#endif
+}
+
+CompletionSignal::~CompletionSignal() {
+#ifndef __linux__
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond);
+#endif
+}
+
+void CompletionSignal::post(int slot) {
+    slot_seqs[slot].fetch_add(1, std::memory_order_release);
+    words[slot / 64].fetch_or((uint64_t)1 << (slot % 64), std::memory_order_seq_cst);
+    epoch.fetch_add(1, std::memory_order_seq_cst);
+
+#ifdef __linux__
+    // only the first post of a batch pays for the syscall
+    if (sleeping.exchange(0, std::memory_order_seq_cst)) {
+        futex_wake(&epoch);
+    }
+#else
+    pthread_mutex_lock(&mutex);
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+#endif
+}
+
+// Appends the completed slots to slots and clears them; returns how many were taken.
+int CompletionSignal::take(std::vector<int>& slots) {
+    int num_taken = 0;
+    for (int w = 0; w < COMPLETION_NUM_WORDS; w++) {
+        if (words[w].load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        uint64_t bits = words[w].exchange(0, std::memory_order_acquire);
+        while (bits != 0) {
+            slots.push_back(w * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+            num_taken++;
+        }
+    }
+    return num_taken;
+}
+
+int CompletionSignal::wait(int64_t deadline_ts, std::vector<int>& slots) {
+    slots.clear();
+
+#ifdef __linux__
+    while (true) {
+        // announce the sleep before sampling the epoch: a post after the sample either sees the
+        // flag and wakes us, or changes the epoch so that futex_wait returns at once
+        sleeping.store(1, std::memory_order_seq_cst);
+        uint32_t seen_epoch = epoch.load(std::memory_order_seq_cst);
+        if (take(slots) > 0) {
+            sleeping.store(0, std::memory_order_relaxed);
+            return 0;
+        }
+
+        int64_t timeout_ms = deadline_ts - get_current_time_milliseconds();
+        if (timeout_ms <= 0) {
+            sleeping.store(0, std::memory_order_relaxed);
+            return ETIMEDOUT;
+        }
+        futex_wait(&epoch, seen_epoch, timeout_ms);
+    }
+#else
+    struct timespec deadline_as_timespec = timepoint_to_timespec(deadline_ts);
+    int ret = 0;
+    pthread_mutex_lock(&mutex);
+    while (take(slots) == 0 && ret != ETIMEDOUT) {
+        ret = pthread_cond_timedwait(&cond, &mutex, &deadline_as_timespec);
+    }
+    pthread_mutex_unlock(&mutex);
+    return slots.empty() ? ETIMEDOUT : 0;
+#endif
+}
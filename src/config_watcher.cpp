@@ -0,0 +1,139 @@
+#include "config_watcher.hpp"
+#include "util.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+
+ConfigWatcher::ConfigWatcher(const std::string& config_path) {
+    this->config_path = config_path;
+
+    size_t slash_pos = config_path.find_last_of('/');
+    if (slash_pos == std::string::npos) {
+        config_dir = ".";
+        config_name = config_path;
+    }
+    else {
+        config_dir = slash_pos == 0 ? "/" : config_path.substr(0, slash_pos);
+        config_name = config_path.substr(slash_pos + 1);
+    }
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+void ConfigWatcher::start() {
+    if (pthread_create(&watch_thread, NULL, watch_func, this) != 0) {
+        std::cerr << "Failed to create config watcher thread" << std::endl;
+        exit(1);
+    }
+    running = 1;
+}
+
+void ConfigWatcher::stop() {
+    if (!running) {
+        return;
+    }
+    running = 0;
+
+    std::atomic_store(&flag_stop, 1);
+    pthread_join(watch_thread, NULL);
+}
+
+void* ConfigWatcher::watch_func(void* arg) {
+    ConfigWatcher* watcher = (ConfigWatcher*)arg;
+#ifdef __linux__
+    watcher->watch_inotify();
+#else
+    watcher->watch_polling();
+#endif
+    return NULL;
+}
+
+void ConfigWatcher::watch_inotify() {
+#ifdef __linux__
+    int inotify_fd = inotify_init1(IN_NONBLOCK);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, config_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        PRINT_THREAD_SUB("inotify unavailable (" << strerror(errno) << "), polling " << config_path);
+        if (inotify_fd >= 0) {
+            close(inotify_fd);
+        }
+        watch_polling();
+        return;
+    }
+
+    // inotify_event carries a variable-length name, so the buffer is aligned for the header
+    alignas(struct inotify_event) char buffer[CONFIG_WATCH_EVENT_BUFFER_SIZE];
+    struct pollfd pfd;
+    pfd.fd = inotify_fd;
+    pfd.events = POLLIN;
+    int64_t last_event_ts = -1;
+    while (!std::atomic_load(&flag_stop)) {
+        int timeout_ms = last_event_ts == -1 ? CONFIG_WATCH_POLL_MS : CONFIG_WATCH_DEBOUNCE_MS;
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            ssize_t num_read;
+            while ((num_read = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+                for (char* ptr = buffer; ptr < buffer + num_read; ) {
+                    struct inotify_event* event = (struct inotify_event*)ptr;
+                    if (event->len > 0 && config_name == event->name) {
+                        last_event_ts = get_current_time_milliseconds();
+                    }
+                    ptr += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+
+        if (last_event_ts != -1 && get_current_time_milliseconds() - last_event_ts >= CONFIG_WATCH_DEBOUNCE_MS) {
+            PRINT_THREAD_SUB("Config changed: " << config_path);
+            std::atomic_store(&flag_changed, 1);
+            last_event_ts = -1;
+        }
+    }
+
+    close(inotify_fd);
+#endif
+}
+
+void ConfigWatcher::watch_polling() {
+    struct stat st;
+    int64_t last_mtime_ns = -1;
+    if (stat(config_path.c_str(), &st) == 0) {
+#ifdef __APPLE__
+        last_mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        last_mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    }
+
+    // a change is raised at the first poll that sees the new mtime unchanged, the poll period being the debounce
+    int pending = 0;
+    while (!std::atomic_load(&flag_stop)) {
+        usleep(CONFIG_WATCH_POLL_MS * 1000);
+        if (stat(config_path.c_str(), &st) != 0) {
+            continue;
+        }
+
+#ifdef __APPLE__
+        int64_t mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        int64_t mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        if (mtime_ns != last_mtime_ns) {
+            last_mtime_ns = mtime_ns;
+            pending = 1;
+        }
+        else if (pending) {
+            PRINT_THREAD_SUB("Config changed: " << config_path);
+            std::atomic_store(&flag_changed, 1);
+            pending = 0;
+        }
+    }
+}
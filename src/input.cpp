@@ -29,3 +29,79 @@ void prepareInputTensor(const std::string& image_filepath, const std::vector<int
         std::copy(preprocessed_image.begin<float>(), preprocessed_image.end<float>(), input_tensor_values.begin() + i * input_tensor_size / batch_size);
     }
 }
+
+struct CropView {
+    int view;
+    int flip;
+};
+
+// full, full flipped, center, center flipped, then the four corners of the zoomed image
+static const CropView crop_views[TTA_MAX_CROPS] = {
+    {TTA_VIEW_FULL, 0}, {TTA_VIEW_FULL, 1}, {TTA_VIEW_CENTER, 0}, {TTA_VIEW_CENTER, 1},
+    {TTA_VIEW_TOP_LEFT, 0}, {TTA_VIEW_TOP_RIGHT, 0}, {TTA_VIEW_BOTTOM_LEFT, 0}, {TTA_VIEW_BOTTOM_RIGHT, 0}
+};
+
+// Writes one BGR crop as normalized RGB planes, flipping horizontally on the way.
+static void write_crop_planes(const cv::Mat& image_BGR, const cv::Rect& roi, int flip, float* dst)
+{
+    const float mean[3] = {0.485f, 0.456f, 0.406f};
+    const float stddev[3] = {0.229f, 0.224f, 0.225f};
+    float scale[3], offset[3];
+    for (int c = 0; c < 3; c++) {
+        scale[c] = 1.0f / (255.0f * stddev[c]);
+        offset[c] = -mean[c] / stddev[c];
+    }
+
+    size_t plane_size = (size_t)roi.width * roi.height;
+    float* planes[3] = {dst, dst + plane_size, dst + 2 * plane_size};
+    for (int y = 0; y < roi.height; y++) {
+        const unsigned char* row = image_BGR.ptr<unsigned char>(roi.y + y) + (size_t)roi.x * 3;
+        size_t out_pos = (size_t)y * roi.width;
+        for (int x = 0; x < roi.width; x++) {
+            const unsigned char* pixel = row + (size_t)(flip ? roi.width - 1 - x : x) * 3;
+            // BGR in, RGB out
+            planes[0][out_pos + x] = pixel[2] * scale[0] + offset[0];
+            planes[1][out_pos + x] = pixel[1] * scale[1] + offset[1];
+            planes[2][out_pos + x] = pixel[0] * scale[2] + offset[2];
+        }
+    }
+}
+
+// Fills the leading num_crops entries of the batch with crops of one decoded image.
+// Each scale is resized once (bilinear, like preprocess_image) and the crops are written straight into the tensor as NCHW;
+// the rest of the batch repeats the crop block.
+void prepare_crop_tensor(const std::string& image_filepath, const std::vector<int64_t>& input_dims, std::vector<float>& input_tensor_values, int num_crops)
+{
+    assert(("Crop count should be between 1 and TTA_MAX_CROPS.", num_crops >= 1 && num_crops <= TTA_MAX_CROPS));
+    int64_t height = input_dims.at(2), width = input_dims.at(3);
+    size_t crop_size = 3 * (size_t)height * width;
+
+    cv::Mat image_BGR = cv::imread(image_filepath, cv::ImreadModes::IMREAD_COLOR);
+    cv::Mat full_BGR, zoomed_BGR;
+    cv::resize(image_BGR, full_BGR, cv::Size(width, height), 0, 0, cv::InterpolationFlags::INTER_LINEAR);
+
+    int zoomed_width = (int)(width * TTA_CROP_SCALE + 0.5), zoomed_height = (int)(height * TTA_CROP_SCALE + 0.5);
+    if (num_crops > 2) {
+        cv::resize(image_BGR, zoomed_BGR, cv::Size(zoomed_width, zoomed_height), 0, 0, cv::InterpolationFlags::INTER_LINEAR);
+    }
+
+    int right = zoomed_width - width, bottom = zoomed_height - height;
+    for (int i = 0; i < num_crops; i++) {
+        const CropView& crop = crop_views[i];
+        const cv::Mat& source = crop.view == TTA_VIEW_FULL ? full_BGR : zoomed_BGR;
+        cv::Rect roi(0, 0, width, height);
+        switch (crop.view) {
+            case TTA_VIEW_CENTER: roi.x = right / 2; roi.y = bottom / 2; break;
+            case TTA_VIEW_TOP_RIGHT: roi.x = right; break;
+            case TTA_VIEW_BOTTOM_LEFT: roi.y = bottom; break;
+            case TTA_VIEW_BOTTOM_RIGHT: roi.x = right; roi.y = bottom; break;
+            default: break;
+        }
+        write_crop_planes(source, roi, crop.flip, input_tensor_values.data() + i * crop_size);
+    }
+
+    size_t block_size = crop_size * num_crops;
+    for (size_t pos = block_size; pos + block_size <= input_tensor_values.size(); pos += block_size) {
+        std::copy(input_tensor_values.begin(), input_tensor_values.begin() + block_size, input_tensor_values.begin() + pos);
+    }
+}
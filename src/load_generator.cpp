@@ -0,0 +1,172 @@
+#include "load_generator.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+
+LoadGenerator::LoadGenerator(int mode, double rate_fps, int burst_size, unsigned int seed)
+    : mode(mode), rate_fps(rate_fps), burst_size(std::max(burst_size, 1)), rng(seed) { }
+
+int LoadGenerator::load_replay(const std::string& replay_path, const std::string& stream_name) {
+    std::ifstream replay_file(replay_path);
+    if (!replay_file.is_open()) {
+        std::cerr << "Failed to open replay file: " << replay_path << std::endl;
+        return -1;
+    }
+
+    replay_offsets.clear();
+    std::string line;
+    while (std::getline(replay_file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream iss(line);
+        double offset_ms;
+        std::string name;
+        if (!(iss >> offset_ms)) {
+            continue;
+        }
+        // lines without a stream name belong to every stream
+        if (iss >> name && name != stream_name) {
+            continue;
+        }
+        replay_offsets.push_back((int64_t)offset_ms);
+    }
+    std::sort(replay_offsets.begin(), replay_offsets.end());
+    replay_cursor = 0;
+    return 0;
+}
+
+int64_t LoadGenerator::next_arrival_ms() {
+    if (mode == LOAD_MODE_REPLAY) {
+        if (replay_cursor >= replay_offsets.size()) {
+            return -1;
+        }
+        return replay_offsets[replay_cursor++];
+    }
+
+    if (mode == LOAD_MODE_BURSTY) {
+        if (burst_left == 0) {
+            std::exponential_distribution<double> gap(rate_fps / burst_size / 1000.0);
+            clock_ms += gap(rng);
+            burst_ts = (int64_t)clock_ms;
+            burst_left = burst_size;
+        }
+        int64_t arrival_ms = burst_ts + (int64_t)(burst_size - burst_left) * LOAD_BURST_SPACING_MS;
+        burst_left--;
+        return arrival_ms;
+    }
+
+    std::exponential_distribution<double> gap(rate_fps / 1000.0);
+    clock_ms += gap(rng);
+    return (int64_t)clock_ms;
+}
+
+void LoadGenerator::restart(double rate_fps) {
+    this->rate_fps = rate_fps;
+    clock_ms = 0.0;
+    burst_left = 0;
+    replay_cursor = 0;
+}
+
+int parse_load_mode(const std::string& mode_name) {
+    if (mode_name == "poisson") {
+        return LOAD_MODE_POISSON;
+    }
+    if (mode_name == "bursty") {
+        return LOAD_MODE_BURSTY;
+    }
+    if (mode_name == "replay") {
+        return LOAD_MODE_REPLAY;
+    }
+
+    std::cerr << "Unknown load mode: " << mode_name << std::endl;
+    exit(1);
+}
+
+// "20,30,40" -> one run per rate
+std::vector<double> parse_load_rates(const std::string& rates) {
+    std::vector<double> rate_list;
+    std::istringstream iss(rates);
+    std::string token;
+    while (std::getline(iss, token, ',')) {
+        double rate_fps = atof(token.c_str());
+        if (rate_fps <= 0) {
+            std::cerr << "Invalid load rate: " << token << std::endl;
+            exit(1);
+        }
+        rate_list.push_back(rate_fps);
+    }
+    return rate_list;
+}
+
+
+// nearest rank
+static double percentile(std::vector<int64_t>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)(p * values.size() + 0.5);
+    return values[std::min(std::max(rank, (size_t)1), values.size()) - 1];
+}
+
+LoadSummary summarize_load(const std::vector<LoadRecord>& records) {
+    LoadSummary summary{(int)records.size(), 0, 0, 0.0};
+
+    std::vector<int64_t> queue_ms, service_ms, response_ms;
+    int64_t first_ts = INT64_MAX, last_ts = INT64_MIN;
+    for (auto& record : records) {
+        summary.num_hits += record.outcome == LOAD_OUTCOME_HIT;
+        summary.num_dropped += record.outcome == LOAD_OUTCOME_DROPPED;
+        queue_ms.push_back(record.queue_ms);
+        response_ms.push_back(record.response_ms);
+        if (record.num_launched > 0) {
+            service_ms.push_back(record.service_ms);
+        }
+        first_ts = std::min(first_ts, record.arrival_ts);
+        last_ts = std::max(last_ts, record.arrival_ts);
+    }
+    if (records.size() > 1 && last_ts > first_ts) {
+        summary.offered_fps = 1000.0 * (records.size() - 1) / (last_ts - first_ts);
+    }
+
+    summary.queue_p50_ms = percentile(queue_ms, 0.50);
+    summary.queue_p99_ms = percentile(queue_ms, 0.99);
+    summary.service_p50_ms = percentile(service_ms, 0.50);
+    summary.service_p99_ms = percentile(service_ms, 0.99);
+    summary.response_p50_ms = percentile(response_ms, 0.50);
+    summary.response_p99_ms = percentile(response_ms, 0.99);
+    return summary;
+}
+
+void print_load_summary(const LoadSummary& summary) {
+    if (summary.num_requests == 0) {
+        return;
+    }
+
+    printf(" - Requests: %d (%.2f fps offered)\n", summary.num_requests, summary.offered_fps);
+    printf(" - Deadline hit rate: %.2f%% (%d/%d), %d dropped before launch\n",
+        100.0 * summary.num_hits / summary.num_requests, summary.num_hits, summary.num_requests, summary.num_dropped);
+    printf(" - Queueing delay: p50 %.0f ms, p99 %.0f ms\n", summary.queue_p50_ms, summary.queue_p99_ms);
+    printf(" - Service time: p50 %.0f ms, p99 %.0f ms\n", summary.service_p50_ms, summary.service_p99_ms);
+    printf(" - Response time: p50 %.0f ms, p99 %.0f ms\n", summary.response_p50_ms, summary.response_p99_ms);
+}
+
+void write_load_records(std::ostream& os, const std::vector<LoadRecord>& records, double rate_fps) {
+    const char* outcomes[] = {"hit", "miss", "dropped"};
+    char line[256];
+    for (auto& record : records) {
+        snprintf(
+            line, sizeof(line), "%.2f\t%d\t%d\t%ld\t%ld\t%ld\t%ld\t%d\t%d\t%s\n",
+            rate_fps, record.request_id, record.stream_id, (long)record.arrival_ts,
+            (long)record.queue_ms, (long)record.service_ms, (long)record.response_ms,
+            record.num_launched, record.num_finished, outcomes[record.outcome]
+        );
+        os << line;
+    }
+}
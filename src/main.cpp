@@ -19,14 +19,99 @@
 
 #include "util.hpp"
 #include "scheduler.hpp"
+#include "config_watcher.hpp"
+#include "tuner.hpp"
 
 #define CONFIG_PATH "./data/imnet.config"
 #define IMAGE_PATH "./data/european-bee-eater-2115564_1920.jpg"
 #define LABEL_PATH "./data/synset.txt"
 #define DEADLINE_MS 33
 #define NUM_TESTS 30
+#define SIMULATION_SEED 0
 
 
+// One open-loop run per rate (a single run for replay); the sustainable rate is the highest one
+// whose deadline hit rate stays at or above target_hit_rate.
+static void run_load(
+    InferenceScheduler& scheduler, const std::string& mode_name, const std::string& load_arg,
+    int burst_size, double target_hit_rate, const std::string& load_log_path, int num_frames
+)
+{
+    int load_mode = parse_load_mode(mode_name);
+    std::vector<double> rates{0.0};
+    if (load_mode != LOAD_MODE_REPLAY) {
+        rates = parse_load_rates(load_arg);
+    }
+
+    std::vector<LoadGenerator*> generators;
+    for (auto& stream : scheduler.get_streams()) {
+        LoadGenerator* generator = new LoadGenerator(load_mode, rates[0], burst_size, SIMULATION_SEED + generators.size());
+        if (load_mode == LOAD_MODE_REPLAY && generator->load_replay(load_arg, stream.name) != 0) {
+            exit(1);
+        }
+        generators.push_back(generator);
+    }
+
+    std::ofstream load_log;
+    if (!load_log_path.empty()) {
+        load_log.open(load_log_path);
+        if (!load_log.is_open()) {
+            std::cerr << "Failed to open load log: " << load_log_path << std::endl;
+            exit(1);
+        }
+        load_log << LOAD_LOG_HEADER << std::endl;
+    }
+
+    double sustainable_fps = 0.0;
+    for (auto rate_fps : rates) {
+        for (auto generator : generators) {
+            generator->restart(rate_fps);
+        }
+        scheduler.serve_load(generators, num_frames);
+
+        LoadSummary summary = summarize_load(scheduler.get_load_records());
+        if (load_mode == LOAD_MODE_REPLAY) {
+            printf("<Load: replay %s>\n", load_arg.c_str());
+        }
+        else {
+            printf("<Load: %s %.2f fps per stream>\n", mode_name.c_str(), rate_fps);
+        }
+        print_load_summary(summary);
+        if (load_log.is_open()) {
+            write_load_records(load_log, scheduler.get_load_records(), rate_fps);
+        }
+
+        if (summary.num_requests > 0 && 100.0 * summary.num_hits / summary.num_requests >= target_hit_rate) {
+            sustainable_fps = std::max(sustainable_fps, rate_fps);
+        }
+    }
+
+    if (rates.size() > 1) {
+        if (sustainable_fps > 0) {
+            printf(" - Sustainable rate: %.2f fps per stream (hit rate >= %.2f%%)\n", sustainable_fps, target_hit_rate);
+        }
+        else {
+            printf(" - Sustainable rate: none of the rates reached a %.2f%% hit rate\n", target_hit_rate);
+        }
+        // frame stats are kept across runs, the per-rate figures are the load summaries above
+        printf(" - The frame summary below covers all %d rates of the sweep\n", (int)rates.size());
+    }
+
+    for (auto generator : generators) {
+        delete generator;
+    }
+}
+
+static void close_result_sink(ResultSink* result_sink)
+{
+    if (result_sink == nullptr) {
+        return;
+    }
+
+    result_sink->close();
+    printf(" - Result log: %ld frames written, %ld dropped\n", (long)result_sink->get_num_written(), (long)result_sink->get_num_dropped());
+}
+
 int main(int argc, char* argv[])
 {
     std::string config_filepath{CONFIG_PATH};
@@ -34,6 +119,33 @@ int main(int argc, char* argv[])
     std::string label_filepath{LABEL_PATH};
     int deadline_ms = DEADLINE_MS;
     int num_tests = NUM_TESTS;
+    std::string simulation_trace_path;
+    std::string record_trace_path;
+    std::vector<std::string> stream_lines;
+    int64_t arena_limit_mb = -1;
+    int arena_shrinkage = 0;
+    int lazy_loading = 0;
+    int64_t memory_budget_mb = 0;
+    std::string result_log_path;
+    std::string result_log_format;
+    int metrics_port = 0;
+    int max_frame_age = 0;
+    int cascade = 0;
+    int ground_truth_id = -1;
+    int watch_config = 0;
+    double thermal_guard_c = 0.0;
+    std::string thermal_sysfs_root{THERMAL_SYSFS_ROOT};
+    std::string profile_path;
+    int profile_top_n = PROFILE_DEFAULT_TOP_N;
+    std::string load_mode_name;
+    std::string load_arg;
+    int load_burst_size = LOAD_DEFAULT_BURST_SIZE;
+    double load_target_hit_rate = LOAD_DEFAULT_TARGET_HIT_RATE;
+    std::string load_log_path;
+    std::string autotune_path;
+    double autotune_target_hit_rate = TUNE_DEFAULT_TARGET_HIT_RATE;
+    double autotune_ensemble_gain = 0.0;
+    std::string profile_store_path;
 
     const int64_t batch_size = 1;
 
@@ -63,6 +175,72 @@ int main(int argc, char* argv[])
         else if (token == "!NUM_TESTS") {
             iss >> num_tests;
         }
+        else if (token == "!SIMULATE") {
+            iss >> simulation_trace_path;
+        }
+        else if (token == "!RECORD_TRACE") {
+            iss >> record_trace_path;
+        }
+        else if (token == "!STREAM") {
+            stream_lines.push_back(line);
+        }
+        else if (token == "!ARENA_LIMIT_MB") {
+            iss >> arena_limit_mb;
+        }
+        else if (token == "!ARENA_SHRINK") {
+            iss >> arena_shrinkage;
+        }
+        else if (token == "!LAZY_LOAD") {
+            iss >> lazy_loading;
+        }
+        else if (token == "!MEMORY_BUDGET_MB") {
+            iss >> memory_budget_mb;
+        }
+        else if (token == "!RESULT_LOG") {
+            iss >> result_log_path >> result_log_format;
+        }
+        else if (token == "!METRICS_PORT") {
+            iss >> metrics_port;
+        }
+        else if (token == "!SPAN_FRAMES") {
+            iss >> max_frame_age;
+        }
+        else if (token == "!CASCADE") {
+            iss >> cascade;
+        }
+        else if (token == "!LABEL_ID") {
+            iss >> ground_truth_id;
+        }
+        else if (token == "!WATCH_CONFIG") {
+            iss >> watch_config;
+        }
+        else if (token == "!THERMAL") {
+            iss >> thermal_guard_c >> thermal_sysfs_root;
+        }
+        else if (token == "!PROFILE_OPS") {
+            iss >> profile_path >> profile_top_n;
+        }
+        else if (token == "!LOAD") {
+            iss >> load_mode_name >> load_arg >> load_burst_size;
+        }
+        else if (token == "!LOAD_TARGET") {
+            iss >> load_target_hit_rate;
+        }
+        else if (token == "!LOAD_LOG") {
+            iss >> load_log_path;
+        }
+        else if (token == "!PROFILE_STORE") {
+            iss >> profile_store_path;
+        }
+        else if (token == "!AUTOTUNE") {
+            iss >> autotune_path >> autotune_target_hit_rate >> autotune_ensemble_gain;
+        }
+    }
+
+    // streams and load runs refer to pools by index, which a reload would reassign
+    if (watch_config && (!stream_lines.empty() || !load_mode_name.empty())) {
+        std::cerr << "Warning: !WATCH_CONFIG is ignored with !STREAM and !LOAD" << std::endl;
+        watch_config = 0;
     }
 
     /* SCHEDULING */
@@ -70,32 +248,184 @@ int main(int argc, char* argv[])
     printf("<Inference Information>\n");
     printf(" - Deadline: %d ms\n", deadline_ms);
 
+    // !AUTOTUNE <output_config> [target_hit_rate] [ensemble_gain]
+    // profiles the commented candidates on this machine (or takes the !SIMULATE trace) and writes
+    // the most accurate ensemble that keeps the hit rate target, validated on real frames when profiled here
+    if (!autotune_path.empty()) {
+        printf(" - Auto-tuning: %.2f%% hit rate target\n", autotune_target_hit_rate);
+        EnsembleTuner tuner(label_filepath, DEFAULT_MAX_THREADS, SIMULATION_SEED);
+        if (tuner.load_accuracies(config_filepath) != 0) {
+            std::cerr << "No \"# <model_path> (<accuracy>%, ...)\" comments in: " << config_filepath << std::endl;
+            exit(1);
+        }
+        if (!simulation_trace_path.empty()) {
+            tuner.use_trace(simulation_trace_path);
+        }
+        else {
+            tuner.profile(image_filepath, autotune_path + ".trace", num_tests);
+        }
+        tuner.search(deadline_ms, autotune_target_hit_rate, autotune_ensemble_gain);
+        tuner.validate();
+        return tuner.write_config(autotune_path, deadline_ms, num_tests) == 0 ? 0 : 1;
+    }
+
     InferenceScheduler scheduler(label_filepath, DEFAULT_MAX_THREADS);
+    SchedulerSimulator* simulator = nullptr;
+    if (!simulation_trace_path.empty()) {
+        printf(" - Simulation trace: %s\n", simulation_trace_path.c_str());
+        simulator = new SchedulerSimulator(simulation_trace_path, SIMULATION_SEED);
+        scheduler.attach_simulator(simulator);
+        scheduler.set_verbose(0);
+    }
+    if (!record_trace_path.empty()) {
+        scheduler.record_trace(record_trace_path);
+    }
+    // frame results go to the log instead of the console
+    ResultSink* result_sink = nullptr;
+    if (!result_log_path.empty()) {
+        printf(" - Result log: %s\n", result_log_path.c_str());
+        result_sink = new ResultSink(result_log_path, parse_result_format(result_log_format), read_labels(label_filepath));
+        scheduler.attach_result_sink(result_sink);
+        scheduler.set_verbose(0);
+    }
+    // !PROFILE_STORE <path>: benchmarks of unchanged models are taken from earlier runs
+    ProfileStore* profile_store = nullptr;
+    if (!profile_store_path.empty() && simulator == nullptr) {
+        profile_store = new ProfileStore(profile_store_path);
+        if (profile_store->load() != 0) {
+            exit(1);
+        }
+        printf(
+            " - Profile store: %s (%d records, %s)\n",
+            profile_store_path.c_str(), profile_store->get_num_records(), profile_store->get_cpu_model().c_str()
+        );
+        scheduler.attach_profile_store(profile_store);
+    }
+    scheduler.configure_memory(arena_limit_mb, arena_shrinkage);
+    scheduler.configure_loading(lazy_loading, memory_budget_mb);
+    scheduler.configure_spanning(max_frame_age);
+    scheduler.configure_cascade(cascade, ground_truth_id);
+    // !PROFILE_OPS <tsv_path> [top_n]
+    if (!profile_path.empty()) {
+        printf(" - Operator profiling: %s (top %d)\n", profile_path.c_str(), profile_top_n);
+        scheduler.configure_profiling(profile_path, profile_top_n);
+    }
+    if (cascade) {
+        printf(" - Cascade: stages in config order\n");
+    }
+    if (max_frame_age > 0) {
+        printf(" - Spanning: up to %d frame(s) late\n", max_frame_age);
+    }
+    // !THERMAL <guard_c> [sysfs_root]
+    ThermalMonitor* thermal_monitor = nullptr;
+    if (thermal_guard_c > 0) {
+        thermal_monitor = new ThermalMonitor(thermal_sysfs_root);
+        scheduler.attach_thermal_monitor(thermal_monitor, thermal_guard_c);
+        printf(
+            " - Thermal guard: %.1f C (%d cpufreq policies, %d thermal zones)\n",
+            thermal_guard_c, thermal_monitor->get_num_policies(), thermal_monitor->get_num_zones()
+        );
+    }
+
     scheduler.load_session_config(config_filepath);
     scheduler.load_input(image_filepath, batch_size);
 
+    // !STREAM <name> <image_path> <deadline_ms> [model indices...]
+    for (auto& stream_line : stream_lines) {
+        std::istringstream iss(stream_line);
+        std::string token, stream_name, stream_image_filepath;
+        int64_t stream_deadline_ms;
+        std::vector<int> pool_idxs;
+        iss >> token >> stream_name >> stream_image_filepath >> stream_deadline_ms;
+
+        int pool_idx;
+        while (iss >> pool_idx) {
+            pool_idxs.push_back(pool_idx);
+        }
+        scheduler.add_stream(stream_name, stream_image_filepath, stream_deadline_ms, pool_idxs);
+        printf(" - Stream %s: %s, %ld ms\n", stream_name.c_str(), stream_image_filepath.c_str(), (long)stream_deadline_ms);
+    }
+
     scheduler.benchmark(num_tests, 2);
+    if (simulator == nullptr) {
+        scheduler.print_memory_report();
+    }
+
+    // Prometheus text endpoint on localhost, counting from here on
+    MetricsServer* metrics_server = nullptr;
+    if (metrics_port > 0) {
+        printf(" - Metrics: http://127.0.0.1:%d/metrics\n", metrics_port);
+        scheduler.get_metrics_registry()->set_start_time(scheduler.get_current_time());
+        metrics_server = new MetricsServer(scheduler.get_metrics_registry(), metrics_port);
+        metrics_server->start();
+    }
+
+    // !LOAD <poisson|bursty|replay> <rate_fps[,rate_fps...]|replay_path> [burst_size]
+    // without streams, frames of the config's deadline go to every model
+    if (!load_mode_name.empty() && stream_lines.empty()) {
+        scheduler.add_stream("load", image_filepath, deadline_ms, std::vector<int>());
+    }
 
-    auto start = std::chrono::system_clock::now();
+    if (!stream_lines.empty() || !load_mode_name.empty()) {
+        if (!load_mode_name.empty()) {
+            run_load(scheduler, load_mode_name, load_arg, load_burst_size, load_target_hit_rate, load_log_path, num_tests);
+        }
+        else {
+            scheduler.serve_streams(num_tests);
+        }
+        close_result_sink(result_sink);
+        scheduler.print_frame_summary();
+        scheduler.save_trace();
+
+        delete metrics_server;
+        delete result_sink;
+        delete thermal_monitor;
+        delete profile_store;
+        delete simulator;
+        return 0;
+    }
+
+    // model lines edited while running are applied at the next frame boundary
+    ConfigWatcher* config_watcher = nullptr;
+    if (watch_config) {
+        printf(" - Watching config: %s\n", config_filepath.c_str());
+        config_watcher = new ConfigWatcher(config_filepath);
+        config_watcher->start();
+    }
+
+    int64_t start_ts = scheduler.get_current_time();
     std::vector<int64_t> elapsed_times;
     for (int i = 0; i < num_tests; i++)
     {
+        if (config_watcher != nullptr && config_watcher->consume_change()) {
+            scheduler.reload_session_config(config_filepath);
+        }
         scheduler.reset_inference();
         
         // wait until start + deadline * i
-        auto target_time = start + std::chrono::milliseconds(deadline_ms * i);
-        std::this_thread::sleep_until(target_time);
+        scheduler.sleep_until(start_ts + (int64_t)deadline_ms * i);
 
-        scheduler.infer(get_current_time_milliseconds() + deadline_ms);
+        scheduler.infer(scheduler.get_current_time() + deadline_ms);
 
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count();
-        elapsed_times.push_back(elapsed);
+        elapsed_times.push_back(scheduler.get_current_time() - start_ts);
     }
 
-    for (auto elapsed_ms : elapsed_times)
-    {
-        std::cout << "Elapsed time: " << elapsed_ms << " ms" << std::endl;
+    close_result_sink(result_sink);
+    if (simulator == nullptr && result_sink == nullptr) {
+        for (auto elapsed_ms : elapsed_times)
+        {
+            std::cout << "Elapsed time: " << elapsed_ms << " ms" << std::endl;
+        }
     }
+    scheduler.print_frame_summary();
+    scheduler.print_cascade_summary();
+    scheduler.save_trace();
 
+    delete config_watcher;
+    delete metrics_server;
+    delete result_sink;
+    delete thermal_monitor;
+    delete profile_store;
+    delete simulator;
     return 0;
 }
\ No newline at end of file
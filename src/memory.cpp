@@ -0,0 +1,116 @@
+#include "memory.hpp"
+#include "session.hpp"
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+SessionMemoryManager::SessionMemoryManager() {
+    pthread_mutex_init(&mutex, NULL);
+}
+
+SessionMemoryManager::~SessionMemoryManager() {
+    for (auto& entry : prepacked_weights) {
+        delete entry.second;
+    }
+    for (auto& entry : model_mappings) {
+        if (entry.second.first != nullptr) {
+            munmap(entry.second.first, entry.second.second);
+        }
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
+// Registers a single CPU arena in the environment; sessions created afterwards allocate from it
+// instead of growing an arena of their own. Must be called before any session is created.
+void SessionMemoryManager::enable_shared_arena(size_t arena_limit_bytes) {
+    if (shared_arena) {
+        return;
+    }
+
+    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    // kSameAsRequested extension keeps the arena close to the real peak usage
+    Ort::ArenaCfg arena_cfg(arena_limit_bytes, 1, -1, -1);
+    get_ort_env().CreateAndRegisterAllocator(memory_info, arena_cfg);
+
+    this->shared_arena = 1;
+    this->arena_limit_bytes = arena_limit_bytes;
+}
+
+void SessionMemoryManager::apply_session_options(Ort::SessionOptions& session_options) {
+    if (shared_arena) {
+        session_options.AddConfigEntry("session.use_env_allocators", "1");
+    }
+}
+
+void SessionMemoryManager::apply_run_options(Ort::RunOptions& run_options) {
+    if (arena_shrinkage) {
+        run_options.AddConfigEntry("memory.enable_memory_arena_shrinkage", "cpu:0");
+    }
+}
+
+// Sessions of the same model file share their prepacked weights, whatever their thread config.
+Ort::PrepackedWeightsContainer* SessionMemoryManager::get_prepacked_weights(const std::string& model_path) {
+    pthread_mutex_lock(&mutex);
+    Ort::PrepackedWeightsContainer*& container = prepacked_weights[model_path];
+    if (container == nullptr) {
+        container = new Ort::PrepackedWeightsContainer();
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return container;
+}
+
+// Maps the model file read-only; the pages are file-backed, so the kernel may drop them
+// under pressure and an evicted session reloads without reading the file again.
+// Returns nullptr if the file cannot be mapped.
+const void* SessionMemoryManager::map_model(const std::string& model_path, size_t* model_size) {
+    pthread_mutex_lock(&mutex);
+    auto it = model_mappings.find(model_path);
+    if (it == model_mappings.end()) {
+        void* data = nullptr;
+        size_t size = 0;
+
+        int fd = open(model_path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = st.st_size;
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                data = nullptr;
+                size = 0;
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        it = model_mappings.insert(std::make_pair(model_path, std::make_pair(data, size))).first;
+    }
+    void* data = it->second.first;
+    *model_size = it->second.second;
+    pthread_mutex_unlock(&mutex);
+
+    return data;
+}
+
+// Drops the model's weight container and mapping; only valid once no session of the model is
+// loaded or loading. A later load creates them again.
+void SessionMemoryManager::release_model(const std::string& model_path) {
+    pthread_mutex_lock(&mutex);
+    auto weights = prepacked_weights.find(model_path);
+    if (weights != prepacked_weights.end()) {
+        delete weights->second;
+        prepacked_weights.erase(weights);
+    }
+    auto mapping = model_mappings.find(model_path);
+    if (mapping != model_mappings.end()) {
+        if (mapping->second.first != nullptr) {
+            munmap(mapping->second.first, mapping->second.second);
+        }
+        model_mappings.erase(mapping);
+    }
+    pthread_mutex_unlock(&mutex);
+}
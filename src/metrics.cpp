@@ -0,0 +1,310 @@
+#include "metrics.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <csignal>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// a scraper hanging up must not raise SIGPIPE; macOS has no MSG_NOSIGNAL but SO_NOSIGPIPE per socket
+#ifdef MSG_NOSIGNAL
+#define METRICS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define METRICS_SEND_FLAGS 0
+#endif
+
+
+LatencyHistogram::LatencyHistogram() {
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucket_index(int64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return std::max(value, (int64_t)0);
+    }
+
+    int exponent = 63 - __builtin_clzll((unsigned long long)value);
+    if (exponent > HISTOGRAM_MAX_EXPONENT) {
+        return HISTOGRAM_NUM_BUCKETS - 1;
+    }
+    int sub_bucket = (value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return HISTOGRAM_SUB_BUCKETS * (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1) + sub_bucket;
+}
+
+int64_t LatencyHistogram::bucket_upper_bound(int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    int exponent = index / HISTOGRAM_SUB_BUCKETS - 1 + HISTOGRAM_SUB_BUCKET_BITS;
+    int sub_bucket = index % HISTOGRAM_SUB_BUCKETS;
+    int64_t lower = (int64_t)(HISTOGRAM_SUB_BUCKETS + sub_bucket) << (exponent - HISTOGRAM_SUB_BUCKET_BITS);
+    return lower + ((int64_t)1 << (exponent - HISTOGRAM_SUB_BUCKET_BITS)) - 1;
+}
+
+void LatencyHistogram::record(int64_t value) {
+    buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+// Highest value equivalent to the bucket holding the q-th sample; 0 if empty.
+int64_t LatencyHistogram::quantile(double q) {
+    int64_t total = 0;
+    int64_t counts[HISTOGRAM_NUM_BUCKETS];
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    int64_t rank = std::max((int64_t)1, (int64_t)(q * total + 0.5));
+    int64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return bucket_upper_bound(i);
+        }
+    }
+    return bucket_upper_bound(HISTOGRAM_NUM_BUCKETS - 1);
+}
+
+
+MetricsRegistry::MetricsRegistry() {
+    pthread_mutex_init(&mutex, NULL);
+}
+
+MetricsRegistry::~MetricsRegistry() {
+    pthread_mutex_destroy(&mutex);
+}
+
+void MetricsRegistry::register_session(const std::string& instance_name, const std::string& model_path, SessionMetrics* metrics) {
+    pthread_mutex_lock(&mutex);
+    session_entries.push_back(SessionEntry{instance_name, model_path, metrics});
+    pthread_mutex_unlock(&mutex);
+}
+
+void MetricsRegistry::unregister_session(SessionMetrics* metrics) {
+    pthread_mutex_lock(&mutex);
+    session_entries.erase(
+        std::remove_if(session_entries.begin(), session_entries.end(), [metrics](const SessionEntry& entry) {
+            return entry.metrics == metrics;
+        }),
+        session_entries.end()
+    );
+    pthread_mutex_unlock(&mutex);
+}
+
+void MetricsRegistry::record_frame(int deadline_hit, int64_t end_ts) {
+    num_frames.fetch_add(1, std::memory_order_relaxed);
+    if (deadline_hit) {
+        num_deadline_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    last_frame_ts.store(end_ts, std::memory_order_relaxed);
+}
+
+// Prometheus text exposition format, version 0.0.4
+std::string MetricsRegistry::render() {
+    std::ostringstream oss;
+
+    oss << "# TYPE raspi_dnn_frames_total counter\n";
+    oss << "raspi_dnn_frames_total " << num_frames.load(std::memory_order_relaxed) << "\n";
+    oss << "# TYPE raspi_dnn_deadline_hits_total counter\n";
+    oss << "raspi_dnn_deadline_hits_total " << num_deadline_hits.load(std::memory_order_relaxed) << "\n";
+    oss << "# TYPE raspi_dnn_thread_budget gauge\n";
+    oss << "raspi_dnn_thread_budget " << max_threads << "\n";
+    oss << "# TYPE raspi_dnn_threads_in_use gauge\n";
+    oss << "raspi_dnn_threads_in_use " << threads_in_use.load(std::memory_order_relaxed) << "\n";
+    if (thermal_enabled) {
+        oss << "# TYPE raspi_dnn_thermal_thread_budget gauge\n";
+        oss << "raspi_dnn_thermal_thread_budget " << thermal_thread_budget.load(std::memory_order_relaxed) << "\n";
+        oss << "# TYPE raspi_dnn_latency_freq_scale gauge\n";
+        oss << "raspi_dnn_latency_freq_scale " << thermal_freq_scale.load(std::memory_order_relaxed) << "\n";
+        oss << "# TYPE raspi_dnn_cpu_temperature_celsius gauge\n";
+        oss << "raspi_dnn_cpu_temperature_celsius " << thermal_temp_c.load(std::memory_order_relaxed) << "\n";
+    }
+
+    const char* counter_names[] = {
+        "raspi_dnn_session_launches_total", "raspi_dnn_session_finishes_total",
+        "raspi_dnn_session_zombies_total", "raspi_dnn_session_cancellations_total",
+        "raspi_dnn_session_busy_thread_ms_total"
+    };
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    pthread_mutex_lock(&mutex);
+    int64_t total_busy_thread_ms = 0;
+    for (int c = 0; c < 5; c++) {
+        oss << "# TYPE " << counter_names[c] << " counter\n";
+        for (auto& entry : session_entries) {
+            SessionMetrics* metrics = entry.metrics;
+            std::atomic<int64_t>* counters[] = {
+                &metrics->num_launches, &metrics->num_finishes,
+                &metrics->num_zombies, &metrics->num_cancellations,
+                &metrics->busy_thread_ms
+            };
+            int64_t value = counters[c]->load(std::memory_order_relaxed);
+            if (c == 4) {
+                total_busy_thread_ms += value;
+            }
+            oss << counter_names[c] << "{session=\"" << entry.instance_name << "\",model=\"" << entry.model_path << "\"} " << value << "\n";
+        }
+    }
+
+    oss << "# TYPE raspi_dnn_session_latency_ms summary\n";
+    for (auto& entry : session_entries) {
+        LatencyHistogram& histogram = entry.metrics->latency_ms;
+        std::string labels = "session=\"" + entry.instance_name + "\",model=\"" + entry.model_path + "\"";
+        for (double q : quantiles) {
+            oss << "raspi_dnn_session_latency_ms{" << labels << ",quantile=\"" << q << "\"} " << histogram.quantile(q) << "\n";
+        }
+        oss << "raspi_dnn_session_latency_ms_sum{" << labels << "} " << histogram.get_sum() << "\n";
+        oss << "raspi_dnn_session_latency_ms_count{" << labels << "} " << histogram.get_count() << "\n";
+    }
+    pthread_mutex_unlock(&mutex);
+
+    // share of the thread budget spent in runs since the first frame
+    int64_t elapsed_ms = last_frame_ts.load(std::memory_order_relaxed) - start_ts;
+    double utilization = 0.0;
+    if (elapsed_ms > 0 && max_threads > 0) {
+        utilization = (double)total_busy_thread_ms / ((double)elapsed_ms * max_threads);
+    }
+    oss << "# TYPE raspi_dnn_thread_utilization gauge\n";
+    oss << "raspi_dnn_thread_utilization " << utilization << "\n";
+
+    return oss.str();
+}
+
+
+MetricsServer::MetricsServer(MetricsRegistry* registry, int port) {
+    this->registry = registry;
+    this->port = port;
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+void MetricsServer::start() {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        std::cerr << "Failed to create metrics socket: " << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    // local only, the endpoint has no authentication
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, METRICS_LISTEN_BACKLOG) != 0) {
+        std::cerr << "Failed to listen on metrics port " << port << ": " << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    if (pthread_create(&server_thread, NULL, serve_func, this) != 0) {
+        std::cerr << "Failed to create metrics server thread" << std::endl;
+        exit(1);
+    }
+    running = 1;
+}
+
+void MetricsServer::stop() {
+    if (!running) {
+        return;
+    }
+    running = 0;
+
+    std::atomic_store(&flag_stop, 1);
+    pthread_join(server_thread, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+}
+
+void* MetricsServer::serve_func(void* arg) {
+    MetricsServer* server = (MetricsServer*)arg;
+
+    struct pollfd pfd;
+    pfd.fd = server->listen_fd;
+    pfd.events = POLLIN;
+    while (!std::atomic_load(&server->flag_stop)) {
+        int ret = poll(&pfd, 1, METRICS_POLL_TIMEOUT_MS);
+        if (ret <= 0) {
+            continue;
+        }
+
+        int client_fd = accept(server->listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            continue;
+        }
+
+        // one client at a time, so one that never sends (or never reads) must not hold the
+        // server thread, nor stop() waiting on it
+        struct timeval timeout;
+        timeout.tv_sec = METRICS_CLIENT_TIMEOUT_MS / 1000;
+        timeout.tv_usec = (METRICS_CLIENT_TIMEOUT_MS % 1000) * 1000;
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+        int no_sigpipe = 1;
+        setsockopt(client_fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+        server->handle_client(client_fd);
+        close(client_fd);
+    }
+
+    return NULL;
+}
+
+void MetricsServer::handle_client(int client_fd) {
+    char request[METRICS_REQUEST_BUFFER_SIZE];
+    ssize_t num_read = recv(client_fd, request, sizeof(request) - 1, 0);
+    if (num_read <= 0) {
+        return;
+    }
+    request[num_read] = '\0';
+
+    std::string status = "200 OK";
+    std::string body;
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        body = registry->render();
+    }
+    else {
+        status = "404 Not Found";
+        body = "not found\n";
+    }
+
+    std::string response =
+        "HTTP/1.0 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t ret = send(client_fd, response.data() + sent, response.size() - sent, METRICS_SEND_FLAGS);
+        if (ret <= 0) {
+            break;
+        }
+        sent += ret;
+    }
+}
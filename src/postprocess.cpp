@@ -0,0 +1,251 @@
+#include "postprocess.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define POSTPROCESS_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define POSTPROCESS_SSE2
+#endif
+
+// exp() for x <= 0 (Cephes polynomial): x = n*ln2 + r, exp(x) = 2^n * p(r)
+#define EXP_LOWER_BOUND -87.3f
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+
+
+static inline float exp_nonpositive(float x)
+{
+    x = std::max(x, EXP_LOWER_BOUND);
+    int32_t n = (int32_t)(x * EXP_LOG2E - 0.5f);     // round to nearest for x <= 0
+    float fn = (float)n;
+    float r = x - fn * EXP_LN2_HI - fn * EXP_LN2_LO;
+
+    float y = EXP_P0;
+    y = y * r + EXP_P1;
+    y = y * r + EXP_P2;
+    y = y * r + EXP_P3;
+    y = y * r + EXP_P4;
+    y = y * r + EXP_P5;
+    y = y * r * r + r + 1.0f;
+
+    int32_t bits = (n + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return y * scale;
+}
+
+#if defined(POSTPROCESS_NEON)
+static inline float32x4_t exp_nonpositive_x4(float32x4_t x)
+{
+    x = vmaxq_f32(x, vdupq_n_f32(EXP_LOWER_BOUND));
+    int32x4_t n = vcvtq_s32_f32(vsubq_f32(vmulq_f32(x, vdupq_n_f32(EXP_LOG2E)), vdupq_n_f32(0.5f)));
+    float32x4_t fn = vcvtq_f32_s32(n);
+    float32x4_t r = vsubq_f32(x, vmulq_f32(fn, vdupq_n_f32(EXP_LN2_HI)));
+    r = vsubq_f32(r, vmulq_f32(fn, vdupq_n_f32(EXP_LN2_LO)));
+
+    float32x4_t y = vdupq_n_f32(EXP_P0);
+    y = vmlaq_f32(vdupq_n_f32(EXP_P1), y, r);
+    y = vmlaq_f32(vdupq_n_f32(EXP_P2), y, r);
+    y = vmlaq_f32(vdupq_n_f32(EXP_P3), y, r);
+    y = vmlaq_f32(vdupq_n_f32(EXP_P4), y, r);
+    y = vmlaq_f32(vdupq_n_f32(EXP_P5), y, r);
+    y = vmlaq_f32(vaddq_f32(r, vdupq_n_f32(1.0f)), y, vmulq_f32(r, r));
+
+    int32x4_t bits = vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23);
+    return vmulq_f32(y, vreinterpretq_f32_s32(bits));
+}
+
+static inline float horizontal_max(float32x4_t v)
+{
+    float32x2_t m = vpmax_f32(vget_low_f32(v), vget_high_f32(v));
+    m = vpmax_f32(m, m);
+    return vget_lane_f32(m, 0);
+}
+
+static inline float horizontal_sum(float32x4_t v)
+{
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    s = vpadd_f32(s, s);
+    return vget_lane_f32(s, 0);
+}
+#elif defined(POSTPROCESS_SSE2)
+static inline __m128 exp_nonpositive_x4(__m128 x)
+{
+    x = _mm_max_ps(x, _mm_set1_ps(EXP_LOWER_BOUND));
+    __m128i n = _mm_cvttps_epi32(_mm_sub_ps(_mm_mul_ps(x, _mm_set1_ps(EXP_LOG2E)), _mm_set1_ps(0.5f)));
+    __m128 fn = _mm_cvtepi32_ps(n);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(EXP_LN2_HI)));
+    r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(EXP_LN2_LO)));
+
+    __m128 y = _mm_set1_ps(EXP_P0);
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P1));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P2));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P3));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P4));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P5));
+    y = _mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(r, r)), _mm_add_ps(r, _mm_set1_ps(1.0f)));
+
+    __m128i bits = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(y, _mm_castsi128_ps(bits));
+}
+
+static inline float horizontal_max(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float horizontal_sum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+void softmax_stable(const float* logits, float* probs, int num_classes, float temperature)
+{
+    float inv_temperature = 1.0f / temperature;
+    int i = 0;
+    float max_logit = -std::numeric_limits<float>::infinity();
+    float exp_sum = 0.0f;
+
+#if defined(POSTPROCESS_NEON)
+    if (num_classes >= 4) {
+        float32x4_t vmax = vld1q_f32(logits);
+        for (i = 4; i + 4 <= num_classes; i += 4) {
+            vmax = vmaxq_f32(vmax, vld1q_f32(logits + i));
+        }
+        max_logit = horizontal_max(vmax);
+    }
+    for (; i < num_classes; i++) {
+        max_logit = std::max(max_logit, logits[i]);
+    }
+
+    float32x4_t vshift = vdupq_n_f32(max_logit);
+    float32x4_t vscale = vdupq_n_f32(inv_temperature);
+    float32x4_t vsum = vdupq_n_f32(0.0f);
+    for (i = 0; i + 4 <= num_classes; i += 4) {
+        float32x4_t e = exp_nonpositive_x4(vmulq_f32(vsubq_f32(vld1q_f32(logits + i), vshift), vscale));
+        vst1q_f32(probs + i, e);
+        vsum = vaddq_f32(vsum, e);
+    }
+    exp_sum = horizontal_sum(vsum);
+#elif defined(POSTPROCESS_SSE2)
+    if (num_classes >= 4) {
+        __m128 vmax = _mm_loadu_ps(logits);
+        for (i = 4; i + 4 <= num_classes; i += 4) {
+            vmax = _mm_max_ps(vmax, _mm_loadu_ps(logits + i));
+        }
+        max_logit = horizontal_max(vmax);
+    }
+    for (; i < num_classes; i++) {
+        max_logit = std::max(max_logit, logits[i]);
+    }
+
+    __m128 vshift = _mm_set1_ps(max_logit);
+    __m128 vscale = _mm_set1_ps(inv_temperature);
+    __m128 vsum = _mm_setzero_ps();
+    for (i = 0; i + 4 <= num_classes; i += 4) {
+        __m128 e = exp_nonpositive_x4(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(logits + i), vshift), vscale));
+        _mm_storeu_ps(probs + i, e);
+        vsum = _mm_add_ps(vsum, e);
+    }
+    exp_sum = horizontal_sum(vsum);
+#else
+    for (; i < num_classes; i++) {
+        max_logit = std::max(max_logit, logits[i]);
+    }
+    i = 0;
+#endif
+
+    for (; i < num_classes; i++) {
+        probs[i] = exp_nonpositive((logits[i] - max_logit) * inv_temperature);
+        exp_sum += probs[i];
+    }
+
+    float inv_sum = 1.0f / exp_sum;
+    for (i = 0; i < num_classes; i++) {
+        probs[i] *= inv_sum;
+    }
+}
+
+// Keeps a sorted list of at most k entries; for k << num_classes this is a single pass.
+void select_top_k(const float* probs, int num_classes, int k, std::vector<Prediction>& top_k)
+{
+    top_k.clear();
+    k = std::min(k, num_classes);
+    if (k <= 0) {
+        return;
+    }
+
+    for (int i = 0; i < num_classes; i++) {
+        if (top_k.size() == k && probs[i] <= top_k.back().probability) {
+            continue;
+        }
+
+        int pos = top_k.size();
+        while (pos > 0 && top_k[pos - 1].probability < probs[i]) {
+            pos--;
+        }
+        top_k.insert(top_k.begin() + pos, Prediction{i, probs[i]});
+        if (top_k.size() > k) {
+            top_k.pop_back();
+        }
+    }
+}
+
+
+Postprocessor::Postprocessor(int top_k) : top_k(top_k) { }
+
+Postprocessor::~Postprocessor() { }
+
+void Postprocessor::process(
+    const std::vector<const float*>& logits, const std::vector<float>& weights, int num_classes,
+    const std::vector<float>& temperatures
+) {
+    this->num_rows = logits.size();
+    this->num_classes = num_classes;
+
+    probs.resize((size_t)num_rows * num_classes);
+    ensemble_probs.assign(num_classes, 0.0f);
+    if (row_top_k.size() < num_rows) {
+        row_top_k.resize(num_rows);
+    }
+
+    float weight_sum = 0.0f;
+    for (int row = 0; row < num_rows; row++) {
+        float* row_probs = probs.data() + (size_t)row * num_classes;
+        softmax_stable(logits[row], row_probs, num_classes, row < temperatures.size() ? temperatures[row] : 1.0f);
+        select_top_k(row_probs, num_classes, top_k, row_top_k[row]);
+
+        float weight = row < weights.size() ? weights[row] : 1.0f;
+        for (int i = 0; i < num_classes; i++) {
+            ensemble_probs[i] += weight * row_probs[i];
+        }
+        weight_sum += weight;
+    }
+
+    if (weight_sum > 0.0f) {
+        float inv_weight_sum = 1.0f / weight_sum;
+        for (int i = 0; i < num_classes; i++) {
+            ensemble_probs[i] *= inv_weight_sum;
+        }
+    }
+    select_top_k(ensemble_probs.data(), num_classes, top_k, ensemble_top_k);
+}
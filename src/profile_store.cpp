@@ -0,0 +1,295 @@
+#include "profile_store.hpp"
+#include "util.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define HASH_SEED 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+// FNV-1a over 8-byte words; models are tens of megabytes, so bytewise hashing would show at startup
+static uint64_t hash_bytes(const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = HASH_SEED ^ size;
+    size_t num_words = size / 8;
+    for (size_t i = 0; i < num_words; i++) {
+        uint64_t word;
+        memcpy(&word, bytes + i * 8, 8);
+        hash = (hash ^ word) * HASH_PRIME;
+        hash ^= hash >> 29;
+    }
+    for (size_t i = num_words * 8; i < size; i++) {
+        hash = (hash ^ bytes[i]) * HASH_PRIME;
+    }
+    return hash;
+}
+
+// "model name" on x86; ARM boards name only the core there, the board is under "Hardware" or "Model"
+std::string read_cpu_model() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    const char* keys[] = {"model name", "Hardware", "Model"};
+    std::string values[3];
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (values[k].empty() && line.compare(0, strlen(keys[k]), keys[k]) == 0) {
+                size_t begin = line.find_first_not_of(" \t", colon + 1);
+                values[k] = begin == std::string::npos ? "" : line.substr(begin);
+            }
+        }
+    }
+
+    std::string cpu_model;
+    for (int k = 0; k < 3; k++) {
+        if (!values[k].empty()) {
+            cpu_model += (cpu_model.empty() ? "" : ", ") + values[k];
+        }
+    }
+    if (cpu_model.empty()) {
+        cpu_model = "unknown";
+    }
+    return cpu_model + " x" + std::to_string(sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+
+ProfileStore::ProfileStore(const std::string& store_path) : store_path(store_path) {
+    cpu_model = read_cpu_model();
+    cpu_hash = hash_bytes(cpu_model.data(), cpu_model.size());
+    pthread_mutex_init(&mutex, NULL);
+}
+
+ProfileStore::~ProfileStore() {
+    unmap();
+    pthread_mutex_destroy(&mutex);
+}
+
+void ProfileStore::unmap() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+    mapped_records = nullptr;
+    num_mapped_records = 0;
+}
+
+// Maps the store; a missing file is an empty store.
+int ProfileStore::load() {
+    unmap();
+
+    int fd = open(store_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ProfileStoreHeader)) {
+        close(fd);
+        return 0;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map profile store: " << store_path << std::endl;
+        return -1;
+    }
+
+    const ProfileStoreHeader* header = (const ProfileStoreHeader*)data;
+    size_t expected_size = sizeof(ProfileStoreHeader) + (size_t)header->num_records * sizeof(ProfileRecord);
+    if (
+        memcmp(header->magic, PROFILE_STORE_MAGIC, sizeof(header->magic)) != 0
+         || header->version != PROFILE_STORE_VERSION
+         || header->record_size != sizeof(ProfileRecord)
+         || expected_size > (size_t)st.st_size
+    ) {
+        std::cerr << "Ignoring profile store of another version: " << store_path << std::endl;
+        munmap(data, st.st_size);
+        return 0;
+    }
+
+    mapping = data;
+    mapping_size = st.st_size;
+    mapped_records = (const ProfileRecord*)((const char*)data + sizeof(ProfileStoreHeader));
+    num_mapped_records = header->num_records;
+    return 0;
+}
+
+uint64_t ProfileStore::model_hash(const std::string& model_path) {
+    pthread_mutex_lock(&mutex);
+    auto it = model_hashes.find(model_path);
+    int cached = it != model_hashes.end();
+    uint64_t cached_hash = cached ? it->second : 0;
+    pthread_mutex_unlock(&mutex);
+    if (cached) {
+        return cached_hash;
+    }
+
+    // 0 for an unreadable model, which never matches and is never stored
+    uint64_t hash = 0;
+    int fd = open(model_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            hash = hash_bytes(data, st.st_size);
+            munmap(data, st.st_size);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    pthread_mutex_lock(&mutex);
+    model_hashes[model_path] = hash;
+    pthread_mutex_unlock(&mutex);
+    return hash;
+}
+
+static int same_config(const ProfileRecord& record, uint64_t cpu_hash, int num_intra_threads, int num_inter_threads, int num_crops) {
+    return record.cpu_hash == cpu_hash
+        && record.num_intra_threads == num_intra_threads
+        && record.num_inter_threads == num_inter_threads
+        && record.num_crops == num_crops;
+}
+
+const ProfileRecord* ProfileStore::find_record(uint64_t hash, int num_intra_threads, int num_inter_threads, int num_crops) {
+    if (hash == 0) {
+        return nullptr;
+    }
+    for (auto& record : new_records) {
+        if (record.model_hash == hash && same_config(record, cpu_hash, num_intra_threads, num_inter_threads, num_crops)) {
+            return &record;
+        }
+    }
+    for (uint32_t i = 0; i < num_mapped_records; i++) {
+        const ProfileRecord& record = mapped_records[i];
+        if (record.model_hash == hash && same_config(record, cpu_hash, num_intra_threads, num_inter_threads, num_crops)) {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+// Benchmark lookup; hashes the model if needed and counts hits and misses.
+const ProfileRecord* ProfileStore::find(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops) {
+    const ProfileRecord* record = find_record(model_hash(model_path), num_intra_threads, num_inter_threads, num_crops);
+    if (record != nullptr) {
+        num_hits++;
+    }
+    else {
+        num_misses++;
+    }
+    return record;
+}
+
+// Frame loop lookup; never hashes and counts nothing, a model not prepared yet has no record.
+const ProfileRecord* ProfileStore::lookup(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops) {
+    pthread_mutex_lock(&mutex);
+    auto it = model_hashes.find(model_path);
+    uint64_t hash = it != model_hashes.end() ? it->second : 0;
+    pthread_mutex_unlock(&mutex);
+
+    return find_record(hash, num_intra_threads, num_inter_threads, num_crops);
+}
+
+void ProfileStore::put(
+    const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops,
+    float latency_ms, int num_runs, int64_t warmup_bytes, const std::vector<int64_t>& ref_freqs_khz
+) {
+    uint64_t hash = model_hash(model_path);
+    if (hash == 0) {
+        return;
+    }
+
+    ProfileRecord record;
+    memset(&record, 0, sizeof(record));
+    record.model_hash = hash;
+    record.cpu_hash = cpu_hash;
+    record.num_intra_threads = num_intra_threads;
+    record.num_inter_threads = num_inter_threads;
+    record.num_crops = num_crops;
+    record.num_runs = num_runs;
+    record.latency_ms = latency_ms;
+    record.warmup_bytes = warmup_bytes;
+    if (ref_freqs_khz.size() <= PROFILE_STORE_MAX_POLICIES) {
+        record.num_policies = ref_freqs_khz.size();
+        for (int i = 0; i < record.num_policies; i++) {
+            record.ref_freqs_khz[i] = (int32_t)ref_freqs_khz[i];
+        }
+    }
+    record.profiled_at = time(nullptr);
+    strncpy(record.model_path, model_path.c_str(), PROFILE_STORE_PATH_LEN - 1);
+    strncpy(record.cpu_model, cpu_model.c_str(), PROFILE_STORE_CPU_LEN - 1);
+
+    for (auto& existing : new_records) {
+        if (existing.model_hash == hash && same_config(existing, cpu_hash, num_intra_threads, num_inter_threads, num_crops)) {
+            existing = record;
+            return;
+        }
+    }
+    new_records.push_back(record);
+}
+
+// Writes the new records and the mapped ones they do not replace. A new record replaces mapped
+// records of the same config for the same contents or the same path, so a changed model leaves
+// no stale entry behind.
+int ProfileStore::save() {
+    if (new_records.empty()) {
+        return 0;
+    }
+
+    std::vector<ProfileRecord> records(new_records);
+    for (uint32_t i = 0; i < num_mapped_records; i++) {
+        const ProfileRecord& record = mapped_records[i];
+        int replaced = 0;
+        for (auto& added : new_records) {
+            if (
+                same_config(record, added.cpu_hash, added.num_intra_threads, added.num_inter_threads, added.num_crops)
+                 && (record.model_hash == added.model_hash || strncmp(record.model_path, added.model_path, PROFILE_STORE_PATH_LEN) == 0)
+            ) {
+                replaced = 1;
+                break;
+            }
+        }
+        if (!replaced) {
+            records.push_back(record);
+        }
+    }
+
+    ProfileStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROFILE_STORE_MAGIC, sizeof(header.magic));
+    header.version = PROFILE_STORE_VERSION;
+    header.record_size = sizeof(ProfileRecord);
+    header.num_records = records.size();
+
+    std::string temp_path = store_path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "Failed to write profile store: " << temp_path << std::endl;
+        return -1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1
+        || fwrite(records.data(), sizeof(ProfileRecord), records.size(), file) != records.size();
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp_path.c_str(), store_path.c_str()) != 0) {
+        std::cerr << "Failed to write profile store: " << store_path << std::endl;
+        unlink(temp_path.c_str());
+        return -1;
+    }
+
+    // the records live in the new file from now on
+    new_records.clear();
+    return load();
+}
@@ -0,0 +1,296 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+
+// Just enough JSON for ORT traces: each event is an object whose scalar fields are collected
+// with nested keys flattened ("args.op_name"); arrays inside events are skipped.
+class TraceReader {
+    public:
+    TraceReader(const std::string& text) : pos(text.data()), end(text.data() + text.size()) {}
+
+    // positions the reader inside the top-level array
+    int begin_events() {
+        skip_space();
+        if (pos == end || *pos != '[') {
+            return -1;
+        }
+        pos++;
+        return 0;
+    }
+
+    // reads the next event into fields; returns 0 at the end of the array
+    int next_event(std::map<std::string, std::string>& fields) {
+        skip_space();
+        if (pos < end && *pos == ',') {
+            pos++;
+            skip_space();
+        }
+        if (pos == end || *pos != '{') {
+            return 0;
+        }
+        fields.clear();
+        return parse_object("", fields) == 0 ? 1 : 0;
+    }
+
+
+    private:
+    const char* pos;
+    const char* end;
+
+    void skip_space() {
+        while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+            pos++;
+        }
+    }
+
+    int parse_string(std::string& out) {
+        out.clear();
+        pos++;  // opening quote
+        while (pos < end && *pos != '"') {
+            if (*pos == '\\' && pos + 1 < end) {
+                pos++;
+                switch (*pos) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': out += '?'; pos += std::min((long)4, (long)(end - pos - 1)); break;
+                    default: out += *pos; break;
+                }
+                pos++;
+                continue;
+            }
+            out += *pos++;
+        }
+        if (pos == end) {
+            return -1;
+        }
+        pos++;  // closing quote
+        return 0;
+    }
+
+    int parse_value(const std::string& key, std::map<std::string, std::string>& fields) {
+        skip_space();
+        if (pos == end) {
+            return -1;
+        }
+        if (*pos == '{') {
+            return parse_object(key + ".", fields);
+        }
+        if (*pos == '[') {
+            return skip_array();
+        }
+        if (*pos == '"') {
+            std::string value;
+            if (parse_string(value) != 0) {
+                return -1;
+            }
+            fields[key] = value;
+            return 0;
+        }
+
+        // number, true, false or null, kept as text
+        const char* start = pos;
+        while (pos < end && *pos != ',' && *pos != '}' && *pos != ']' && *pos != ' ' && *pos != '\n') {
+            pos++;
+        }
+        fields[key] = std::string(start, pos);
+        return 0;
+    }
+
+    int parse_object(const std::string& prefix, std::map<std::string, std::string>& fields) {
+        pos++;  // opening brace
+        std::string key;
+        while (true) {
+            skip_space();
+            if (pos == end) {
+                return -1;
+            }
+            if (*pos == '}') {
+                pos++;
+                return 0;
+            }
+            if (*pos == ',') {
+                pos++;
+                continue;
+            }
+            if (*pos != '"' || parse_string(key) != 0) {
+                return -1;
+            }
+            skip_space();
+            if (pos == end || *pos != ':') {
+                return -1;
+            }
+            pos++;
+            if (parse_value(prefix + key, fields) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    int skip_array() {
+        int depth = 0;
+        std::string ignored;
+        while (pos < end) {
+            if (*pos == '"') {
+                if (parse_string(ignored) != 0) {
+                    return -1;
+                }
+                continue;
+            }
+            if (*pos == '[' || *pos == '{') {
+                depth++;
+            }
+            else if (*pos == ']' || *pos == '}') {
+                depth--;
+                if (depth == 0) {
+                    pos++;
+                    return 0;
+                }
+            }
+            pos++;
+        }
+        return -1;
+    }
+
+};
+
+
+int OperatorProfile::load(const std::string& trace_path, int num_last_runs) {
+    std::ifstream trace_file(trace_path);
+    if (!trace_file.is_open()) {
+        std::cerr << "Failed to open profiling trace: " << trace_path << std::endl;
+        return -1;
+    }
+    std::stringstream buffer;
+    buffer << trace_file.rdbuf();
+    std::string text = buffer.str();
+
+    TraceReader reader(text);
+    if (reader.begin_events() != 0) {
+        std::cerr << "Not a profiling trace: " << trace_path << std::endl;
+        return -1;
+    }
+
+    struct RunWindow { int64_t start_us; int64_t end_us; };
+    struct KernelEvent { int64_t ts_us; int64_t dur_us; std::string name; std::string op_type; };
+    std::vector<RunWindow> runs;
+    std::vector<KernelEvent> kernels;
+
+    // node events are named <node>_kernel_time, next to their _fence_before/_fence_after markers
+    const std::string kernel_suffix = "_kernel_time";
+    std::map<std::string, std::string> fields;
+    while (reader.next_event(fields)) {
+        const std::string& category = fields["cat"];
+        const std::string& name = fields["name"];
+        int64_t ts_us = atoll(fields["ts"].c_str());
+        int64_t dur_us = atoll(fields["dur"].c_str());
+
+        if (category == "Session" && name == "model_run") {
+            runs.push_back(RunWindow{ts_us, ts_us + dur_us});
+        }
+        else if (
+            category == "Node" && name.size() > kernel_suffix.size()
+             && name.compare(name.size() - kernel_suffix.size(), kernel_suffix.size(), kernel_suffix) == 0
+        ) {
+            kernels.push_back(KernelEvent{ts_us, dur_us, name.substr(0, name.size() - kernel_suffix.size()), fields["args.op_name"]});
+        }
+    }
+
+    std::sort(runs.begin(), runs.end(), [](const RunWindow& a, const RunWindow& b) {
+        return a.start_us < b.start_us;
+    });
+    if (runs.empty()) {
+        std::cerr << "No profiled runs in: " << trace_path << std::endl;
+        return -1;
+    }
+    if (num_last_runs > 0 && runs.size() > num_last_runs) {
+        runs.erase(runs.begin(), runs.end() - num_last_runs);
+    }
+
+    num_runs = runs.size();
+    total_run_us = 0;
+    for (auto& run : runs) {
+        total_run_us += run.end_us - run.start_us;
+    }
+
+    op_types.clear();
+    nodes.clear();
+    for (auto& kernel : kernels) {
+        auto run = std::upper_bound(runs.begin(), runs.end(), kernel.ts_us, [](int64_t ts_us, const RunWindow& window) {
+            return ts_us < window.start_us;
+        });
+        if (run == runs.begin() || kernel.ts_us > (run - 1)->end_us) {
+            continue;   // warmup or outside any run
+        }
+
+        OperatorStat& op = op_types[kernel.op_type];
+        op.name = kernel.op_type;
+        op.op_type = kernel.op_type;
+        op.total_us += kernel.dur_us;
+        op.num_calls++;
+
+        OperatorStat& node = nodes[kernel.name];
+        node.name = kernel.name;
+        node.op_type = kernel.op_type;
+        node.total_us += kernel.dur_us;
+        node.num_calls++;
+    }
+
+    return 0;
+}
+
+void OperatorProfile::print_top(int top_n) {
+    double run_us = get_run_us();
+    printf(" - Runs: %d, %.2f ms per run\n", num_runs, run_us / 1000.0);
+
+    const char* titles[] = {"Operators", "Nodes"};
+    std::map<std::string, OperatorStat>* tables[] = {&op_types, &nodes};
+    for (int t = 0; t < 2; t++) {
+        std::vector<OperatorStat> sorted;
+        for (auto& entry : *tables[t]) {
+            sorted.push_back(entry.second);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const OperatorStat& a, const OperatorStat& b) {
+            return a.total_us > b.total_us;
+        });
+
+        printf(" - Top %s:\n", titles[t]);
+        for (int i = 0; i < std::min(top_n, (int)sorted.size()); i++) {
+            OperatorStat& stat = sorted[i];
+            double us_per_run = (double)stat.total_us / num_runs;
+            printf(
+                "   %6.2f ms %5.1f%%  %s%s%s (%.1f calls)\n",
+                us_per_run / 1000.0, run_us > 0 ? 100.0 * us_per_run / run_us : 0.0,
+                stat.name.c_str(), t == 1 ? " : " : "", t == 1 ? stat.op_type.c_str() : "",
+                (double)stat.num_calls / num_runs
+            );
+        }
+    }
+}
+
+void OperatorProfile::write_tsv(std::ostream& os, const std::string& model_path, int num_intra_threads, int num_inter_threads) {
+    char line[512];
+    double run_us = get_run_us();
+    std::string key = model_path + "\t" + std::to_string(num_intra_threads) + "\t" + std::to_string(num_inter_threads);
+    snprintf(line, sizeof(line), "run\t%s\t-\t-\t1.0\t%.1f\t1.000\n", key.c_str(), run_us);
+    os << line;
+
+    const char* kinds[] = {"op", "node"};
+    std::map<std::string, OperatorStat>* tables[] = {&op_types, &nodes};
+    for (int t = 0; t < 2; t++) {
+        for (auto& entry : *tables[t]) {
+            OperatorStat& stat = entry.second;
+            double us_per_run = (double)stat.total_us / num_runs;
+            snprintf(
+                line, sizeof(line), "%s\t%s\t%s\t%s\t%.1f\t%.1f\t%.3f\n",
+                kinds[t], key.c_str(), stat.name.c_str(), stat.op_type.c_str(),
+                (double)stat.num_calls / num_runs, us_per_run, run_us > 0 ? us_per_run / run_us : 0.0
+            );
+            os << line;
+        }
+    }
+}
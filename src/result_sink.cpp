@@ -0,0 +1,160 @@
+#include "result_sink.hpp"
+#include "util.hpp"
+
+#include <cstring>
+#include <unistd.h>
+
+
+int parse_result_format(const std::string& format_name) {
+    if (format_name.empty() || format_name == "jsonl") {
+        return RESULT_FORMAT_JSONL;
+    }
+    if (format_name == "bin" || format_name == "binary") {
+        return RESULT_FORMAT_BINARY;
+    }
+
+    std::cerr << "Unknown result log format: " << format_name << std::endl;
+    exit(1);
+}
+
+static void write_json_string(FILE* file, const std::string& str) {
+    fputc('"', file);
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+
+ResultSink::ResultSink(const std::string& log_path, int format, const std::vector<std::string>& labels) {
+    this->log_path = log_path;
+    this->format = format;
+    this->labels = labels;
+
+    log_file = fopen(log_path.c_str(), format == RESULT_FORMAT_BINARY ? "wb" : "w");
+    if (log_file == nullptr) {
+        std::cerr << "Failed to open result log: " << log_path << std::endl;
+        exit(1);
+    }
+
+    if (format == RESULT_FORMAT_BINARY) {
+        ResultFileHeader header;
+        memset(&header, 0, sizeof(header));
+        strncpy(header.magic, RESULT_BINARY_MAGIC, sizeof(header.magic));
+        header.version = RESULT_BINARY_VERSION;
+        header.record_size = sizeof(FrameRecord);
+        fwrite(&header, sizeof(header), 1, log_file);
+    }
+
+    if (pthread_create(&writer_thread, NULL, writer_func, this) != 0) {
+        std::cerr << "Failed to create result writer thread" << std::endl;
+        exit(1);
+    }
+}
+
+ResultSink::~ResultSink() {
+    close();
+}
+
+// Called from the scheduler thread only.
+void ResultSink::push(const FrameRecord& record) {
+    if (!ring.try_push(record)) {
+        std::atomic_fetch_add(&num_dropped, (int64_t)1);
+    }
+}
+
+void ResultSink::close() {
+    if (closed) {
+        return;
+    }
+    closed = 1;
+
+    std::atomic_store(&flag_stop, 1);
+    pthread_join(writer_thread, NULL);
+
+    fclose(log_file);
+    log_file = nullptr;
+}
+
+void* ResultSink::writer_func(void* arg) {
+    ResultSink* sink = (ResultSink*)arg;
+    FrameRecord record;
+
+    while (true) {
+        // read the flag first so records pushed before close() are still drained
+        int stop = std::atomic_load(&sink->flag_stop);
+        int num_popped = 0;
+        while (sink->ring.try_pop(record)) {
+            sink->write_record(record);
+            num_popped++;
+        }
+
+        if (num_popped > 0) {
+            fflush(sink->log_file);
+        }
+        else if (stop) {
+            break;
+        }
+        else {
+            usleep(RESULT_SINK_POLL_US);
+        }
+    }
+
+    return NULL;
+}
+
+void ResultSink::write_record(const FrameRecord& record) {
+    num_written++;
+
+    if (format == RESULT_FORMAT_BINARY) {
+        fwrite(&record, sizeof(record), 1, log_file);
+        return;
+    }
+
+    fprintf(log_file,
+        "{\"frame\":%d,\"stream\":%d,\"start_ts\":%lld,\"end_ts\":%lld,\"deadline_ts\":%lld,"
+        "\"latency_ms\":%lld,\"launched\":%d,\"finished\":%d",
+        record.frame_id, record.stream_id,
+        (long long)record.start_ts, (long long)record.end_ts, (long long)record.deadline_ts,
+        (long long)(record.end_ts - record.start_ts), record.num_launched, record.num_finished
+    );
+
+    fputs(",\"model_latency_ms\":{", log_file);
+    int first = 1;
+    for (int pool_idx = 0; pool_idx < RESULT_MAX_POOLS; pool_idx++) {
+        if (record.finished_pool_mask & (1u << pool_idx)) {
+            fprintf(log_file, "%s\"%d\":%d", first ? "" : ",", pool_idx, record.pool_latency_ms[pool_idx]);
+            first = 0;
+        }
+    }
+
+    fputs("},\"missed\":[", log_file);
+    first = 1;
+    for (int pool_idx = 0; pool_idx < RESULT_MAX_POOLS; pool_idx++) {
+        if (record.missed_pool_mask & (1u << pool_idx)) {
+            fprintf(log_file, "%s%d", first ? "" : ",", pool_idx);
+            first = 0;
+        }
+    }
+
+    fputs("],\"aged\":{", log_file);
+    first = 1;
+    for (int pool_idx = 0; pool_idx < RESULT_MAX_POOLS; pool_idx++) {
+        if (record.aged_pool_mask & (1u << pool_idx)) {
+            fprintf(log_file, "%s\"%d\":%d", first ? "" : ",", pool_idx, record.pool_frame_age[pool_idx]);
+            first = 0;
+        }
+    }
+
+    fputs("},\"predictions\":[", log_file);
+    for (int i = 0; i < record.num_predictions; i++) {
+        int label_id = record.label_ids[i];
+        fprintf(log_file, "%s{\"id\":%d,\"label\":", i == 0 ? "" : ",", label_id);
+        write_json_string(log_file, label_id < labels.size() ? labels[label_id] : std::string());
+        fprintf(log_file, ",\"prob\":%.6f}", record.probabilities[i]);
+    }
+    fputs("]}\n", log_file);
+}
@@ -1,6 +1,7 @@
 #include "scheduler.hpp"
 #include "session.hpp"
 #include "util.hpp"
+#include "input.hpp"
 
 // output vector
 template <typename T>
@@ -22,38 +23,261 @@ InferenceScheduler::InferenceScheduler(const std::string& label_path, int max_th
     this->labels = read_labels(label_path);
     
     this->max_threads = max_threads;
+    this->thread_budget = max_threads;
     this->threads_using = 0;
     this->lagging = 1.0;
-
-    pthread_mutex_init(&any_finished_mutex, NULL);
-    pthread_cond_init(&any_finished_cond, NULL);
+    metrics_registry.set_thread_budget(max_threads);
 }
 
 InferenceScheduler::~InferenceScheduler() { }
 
+// arena_limit_mb < 0 keeps a private arena per session
+void InferenceScheduler::configure_memory(int64_t arena_limit_mb, int arena_shrinkage) {
+    assert(("Memory must be configured before sessions are added.", sessions.empty()));
+
+    if (arena_limit_mb >= 0 && simulator == nullptr) {
+        memory_manager.enable_shared_arena(arena_limit_mb * 1024 * 1024);
+    }
+    memory_manager.set_arena_shrinkage(arena_shrinkage);
+}
+
+// memory_budget_mb <= 0 never evicts
+void InferenceScheduler::configure_loading(int lazy_loading, int64_t memory_budget_mb) {
+    assert(("Loading must be configured before sessions are added.", sessions.empty()));
+
+    this->lazy_loading = lazy_loading && simulator == nullptr;
+    this->memory_budget_bytes = std::max(memory_budget_mb, (int64_t)0) * 1024 * 1024;
+}
+
+void InferenceScheduler::print_memory_report() {
+    printf("<Memory Report>\n");
+    for (int snum = 0; snum < sessions.size(); snum++) {
+        InferenceSession* session = sessions[snum];
+        if (session == nullptr) {
+            continue;
+        }
+        if (!session->is_loaded()) {
+            printf(" - %s: not loaded\n", session->get_instance_name().c_str());
+            continue;
+        }
+        printf(
+            " - %s: load %.1f MB, warmup %.1f MB\n",
+            session->get_instance_name().c_str(),
+            session->get_resident_bytes() / 1048576.0, session_warmup_bytes[snum] / 1048576.0
+        );
+    }
+    printf(" - Shared weight containers: %d\n", memory_manager.get_num_prepacked_containers());
+    if (memory_manager.get_shared_arena()) {
+        if (memory_manager.get_arena_limit_bytes() > 0) {
+            printf(" - Shared arena: limit %.1f MB\n", memory_manager.get_arena_limit_bytes() / 1048576.0);
+        }
+        else {
+            printf(" - Shared arena: unlimited\n");
+        }
+    }
+    printf(" - Resident: %.1f MB\n", get_resident_memory_bytes() / 1048576.0);
+}
+
+void InferenceScheduler::attach_simulator(SchedulerSimulator* simulator) {
+    assert(("Simulator must be attached before sessions are added.", sessions.empty()));
+    this->simulator = simulator;
+}
+
+// max_frame_age 0 keeps every run within its own frame
+void InferenceScheduler::configure_spanning(int max_frame_age) {
+    this->max_frame_age = max_frame_age;
+}
+
+// ground_truth_id (-1 if unknown) is the label of the input, used to report accuracy
+void InferenceScheduler::configure_cascade(int cascade, int ground_truth_id) {
+    this->cascade = cascade;
+    this->ground_truth_id = ground_truth_id;
+}
+
+// guard_c: headroom to the throttling trip point below which the thread budget starts to shrink
+void InferenceScheduler::attach_thermal_monitor(ThermalMonitor* thermal_monitor, double guard_c) {
+    this->thermal_monitor = thermal_monitor;
+    this->thermal_guard_c = guard_c;
+    metrics_registry.enable_thermal();
+}
+
+// profile_path is the TSV report; ORT traces are written next to it
+void InferenceScheduler::configure_profiling(const std::string& profile_path, int top_n) {
+    assert(("Profiling must be configured before sessions are added.", sessions.empty()));
+
+    this->profile_path = profile_path;
+    this->profile_top_n = top_n;
+}
+
+void InferenceScheduler::attach_profile_store(ProfileStore* profile_store) {
+    this->profile_store = profile_store;
+}
+
+void InferenceScheduler::attach_result_sink(ResultSink* result_sink) {
+    this->result_sink = result_sink;
+}
+
+void InferenceScheduler::record_trace(const std::string& trace_path) {
+    this->trace_path = trace_path;
+}
+
+void InferenceScheduler::save_trace() {
+    if (trace_path.empty()) {
+        return;
+    }
+
+    std::ofstream trace_file(trace_path);
+    if (!trace_file.is_open()) {
+        std::cerr << "Failed to open latency trace: " << trace_path << std::endl;
+        return;
+    }
+
+    trace_file << "# model_path num_intra num_inter [crops=n] latency_ms..." << std::endl;
+    for (int snum = 0; snum < sessions.size(); snum++) {
+        if (sessions[snum] == nullptr || session_latency_traces[snum].empty()) {
+            continue;
+        }
+
+        InferenceSession* session = sessions[snum];
+        trace_file << session->get_model_path() << " " << session->get_num_intra_threads() << " " << session->get_num_inter_threads();
+        if (session->get_num_crops() > 1) {
+            trace_file << " crops=" << session->get_num_crops();
+        }
+        for (auto latency : session_latency_traces[snum]) {
+            trace_file << " " << latency;
+        }
+        trace_file << std::endl;
+    }
+}
+
+void InferenceScheduler::trace_latency(int session_idx) {
+    if (trace_path.empty()) {
+        return;
+    }
+
+    int64_t latency = sessions[session_idx]->get_finish_time() - session_launch_times[session_idx];
+    session_latency_traces[session_idx].push_back(latency);
+}
+
+// Adds a pool of num_replicas sessions of the same model.
+// Replicas share prepacked weights (as does every session of the same model file) but own
+// their I/O buffers, so a replica can start the next frame while another one is still
+// finishing the previous frame.
 void InferenceScheduler::add_session(
     const std::string& model_path, float weight,
-    int num_intra_threads, int num_inter_threads
+    int num_intra_threads, int num_inter_threads,
+    int num_replicas
 ) {
-    std::string instance_name = std::to_string(sessions.size()) + "_" + model_path;
-    InferenceSession* session = new InferenceSession(
-        instance_name, model_path, label_path, 
-        num_intra_threads, num_inter_threads
-    );
-    sessions.push_back(session);
-    session_weights.push_back(0.0);
-    session_inference_times.push_back(0.0);
+    add_pool(SessionConfig{
+        model_path, weight, num_intra_threads, num_inter_threads,
+        num_replicas, 1.0, CASCADE_DEFAULT_THRESHOLD, 1
+    }, lazy_loading);
+}
+
+int InferenceScheduler::add_pool(const SessionConfig& config, int lazy_load) {
+    const std::string& model_path = config.model_path;
+
+    // a retired pool whose sessions are all freed is referenced nowhere, its index is reused
+    // so that reloads keep the live pools within RESULT_MAX_POOLS
+    int pool_idx = pool_sessions.size();
+    for (int i = 0; i < pool_sessions.size(); i++) {
+        if (pool_retired[i] && pool_sessions[i].empty()) {
+            pool_idx = i;
+            break;
+        }
+    }
+    if (pool_idx == pool_sessions.size()) {
+        pool_sessions.push_back(std::vector<int>());
+        pool_temperatures.push_back(0.0);
+        pool_thresholds.push_back(0.0);
+        pool_configs.push_back(config);
+        pool_retired.push_back(0);
+        pool_successors.push_back(-1);
+    }
+    pool_temperatures[pool_idx] = config.temperature;
+    pool_thresholds[pool_idx] = config.threshold;
+    pool_configs[pool_idx] = config;
+    pool_retired[pool_idx] = 0;
+    pool_successors[pool_idx] = -1;
+    pool_order.push_back(pool_idx);
+
+    for (int replica = 0; replica < config.num_replicas; replica++) {
+        // slots freed by removed pools are reused, so reloads do not grow the session tables
+        int session_idx = sessions.size();
+        if (!free_session_slots.empty()) {
+            session_idx = free_session_slots.back();
+            free_session_slots.pop_back();
+        }
+        else {
+            if (sessions.size() >= COMPLETION_MAX_SLOTS) {
+                std::cerr << "Too many sessions, at most " << COMPLETION_MAX_SLOTS << " are supported" << std::endl;
+                exit(1);
+            }
+            sessions.push_back(nullptr);
+            session_warmup_bytes.push_back(0);
+            session_profiled.push_back(0);
+            session_num_launches.push_back(0);
+            session_last_used.push_back(-1);
+            session_launch_frames.push_back(0);
+            session_span_deadlines.push_back(0);
+            session_pools.push_back(-1);
+            session_weights.push_back(0.0);
+            session_inference_times.push_back(0.0);
+            session_launch_times.push_back(0);
+            session_latency_traces.push_back(std::vector<int64_t>());
+            session_owners.push_back(-1);
+        }
+
+        std::string instance_name = std::to_string(session_idx) + "_" + model_path;
+        int profile = !profile_path.empty() && !profiles_reported && replica == 0 && simulator == nullptr;
+        InferenceSession* session = new InferenceSession(
+            instance_name, model_path, label_path, 
+            config.num_intra_threads, config.num_inter_threads,
+            simulator, simulator == nullptr ? &memory_manager : nullptr,
+            lazy_load || profile, config.num_crops
+        );
+        if (profile_store != nullptr && simulator == nullptr) {
+            session->attach_profile_store(profile_store);
+        }
+        // profiling is a session option, so the model is loaded only once it is set
+        if (profile) {
+            session->enable_profiling(profile_path + "." + std::to_string(session_idx));
+            if (!lazy_load) {
+                session->load_model(0);
+            }
+        }
+        session_warmup_bytes[session_idx] = 0;
+        session_profiled[session_idx] = 0;
+        session_num_launches[session_idx] = 0;
+        session_last_used[session_idx] = -1;
+        session_launch_frames[session_idx] = 0;
+        session_span_deadlines[session_idx] = 0;
+        pool_sessions[pool_idx].push_back(session_idx);
+        session_pools[session_idx] = pool_idx;
 
-    session->add_finish_listener(&any_finished_mutex, &any_finished_cond);
+        sessions[session_idx] = session;
+        session_weights[session_idx] = config.weight;
+        session_inference_times[session_idx] = 0.0;
+        session_launch_times[session_idx] = 0;
+        session_latency_traces[session_idx].clear();
+        session_owners[session_idx] = -1;
+
+        // completions are counted per slot, so a reused slot needs no reset
+        session->attach_completion_signal(&completion_signal, session_idx);
+        metrics_registry.register_session(instance_name, model_path, session->get_metrics());
+    }
+    return pool_idx;
 }
 
-void InferenceScheduler::load_session_config(const std::string& config_path) {
+// Returns -1 on a missing file or a malformed model line; the caller decides whether that is fatal.
+int parse_session_config(const std::string& config_path, std::vector<SessionConfig>& configs) {
     std::ifstream config_file(config_path);
     if (!config_file.is_open()) {
         std::cerr << "Failed to open config file: " << config_path << std::endl;
-        exit(1);
+        return -1;
     }
 
+    configs.clear();
     std::string line;
     while (std::getline(config_file, line)) {
         if (line.empty() || line[0] == '#' || line[0] == '!')
@@ -63,11 +287,78 @@ void InferenceScheduler::load_session_config(const std::string& config_path) {
         std::string model_path;
         float weight;
         int num_intra_threads, num_inter_threads;
-        iss >> model_path >> weight >> num_intra_threads >> num_inter_threads;
-        add_session(model_path, weight, num_intra_threads, num_inter_threads);
+        if (!(iss >> model_path >> weight >> num_intra_threads >> num_inter_threads)) {
+            std::cerr << "Invalid model line: " << line << std::endl;
+            return -1;
+        }
+
+        // optional <key>=<value> options
+        int num_replicas = 1, num_crops = 1;
+        float temperature = 1.0, threshold = CASCADE_DEFAULT_THRESHOLD;
+        std::string option;
+        while (iss >> option) {
+            size_t eq_pos = option.find('=');
+            std::string key = option.substr(0, eq_pos);
+            std::string value = eq_pos == std::string::npos ? "" : option.substr(eq_pos + 1);
+            // the whole value must parse, "crops=2x" is rejected rather than read as 2
+            char* int_end = nullptr;
+            char* float_end = nullptr;
+            long int_value = strtol(value.c_str(), &int_end, 10);
+            float float_value = strtof(value.c_str(), &float_end);
+            int is_int = !value.empty() && *int_end == '\0';
+            int is_float = !value.empty() && *float_end == '\0';
+
+            if (
+                ((key == "replicas" || key == "crops") && !is_int)
+                 || ((key == "temperature" || key == "threshold") && !is_float)
+            ) {
+                std::cerr << "Invalid session option: " << option << std::endl;
+            }
+            else if (key == "replicas") {
+                num_replicas = std::max((int)int_value, 1);
+            }
+            else if (key == "temperature") {
+                temperature = float_value;
+            }
+            else if (key == "threshold") {
+                threshold = float_value;
+            }
+            else if (key == "crops") {
+                num_crops = (int)int_value;
+            }
+            else {
+                std::cerr << "Unknown session option: " << option << std::endl;
+            }
+        }
+
+        if (temperature <= 0) {
+            std::cerr << "Temperature must be positive: " << line << std::endl;
+            return -1;
+        }
+        if (num_crops < 1 || num_crops > TTA_MAX_CROPS) {
+            std::cerr << "Crop count must be between 1 and " << TTA_MAX_CROPS << ": " << line << std::endl;
+            return -1;
+        }
+        configs.push_back(SessionConfig{
+            model_path, weight, num_intra_threads, num_inter_threads,
+            num_replicas, temperature, threshold, num_crops
+        });
+    }
+
+    return 0;
+}
+
+void InferenceScheduler::load_session_config(const std::string& config_path) {
+    std::vector<SessionConfig> configs;
+    if (parse_session_config(config_path, configs) != 0) {
+        exit(1);
+    }
+    for (auto& config : configs) {
+        add_pool(config, lazy_loading);
     }
 
     enqueue_inference_naive();
+    balance_replicas();
 
     PRINT_THREAD_MAIN("Sessions loaded");
     PRINT_THREAD_MAIN("QUEUE (unready): " << session_unready_queue);
@@ -76,14 +367,230 @@ void InferenceScheduler::load_session_config(const std::string& config_path) {
     PRINT_THREAD_MAIN("QUEUE (finished): " << session_finished_queue);
 }
 
+// Diffs the config against the active pools; takes effect at the next reset_inference().
+// A line matching a pool's model, threads, replicas and crops updates its weight and calibration in place.
+// A line with the same model but other threads, replicas or crops gets a new pool that replaces the old
+// one once loaded. New models load in the background, removed ones are drained and freed.
+// A config that fails to parse or has no model lines is ignored, so a half-written file keeps the current pools.
+void InferenceScheduler::reload_session_config(const std::string& config_path) {
+    std::vector<SessionConfig> configs;
+    if (parse_session_config(config_path, configs) != 0) {
+        printf("Config reload failed, keeping the current sessions\n");
+        return;
+    }
+    if (configs.empty()) {
+        printf("Config reload skipped, no model lines\n");
+        return;
+    }
+
+    // replacements still loading from an earlier reload are dropped, the diff starts over
+    for (auto pool_idx : pool_order) {
+        if (pool_successors[pool_idx] != -1) {
+            pool_retired[pool_successors[pool_idx]] = 1;
+            pool_successors[pool_idx] = -1;
+        }
+    }
+
+    int num_added = 0, num_updated = 0, num_replaced = 0, num_removed = 0;
+    std::vector<int> matched(pool_sessions.size(), 0);
+    std::vector<int> new_order;
+    for (auto& config : configs) {
+        int keep_pool = -1, replace_pool = -1;
+        for (auto pool_idx : pool_order) {
+            SessionConfig& current = pool_configs[pool_idx];
+            if (matched[pool_idx] || current.model_path != config.model_path) {
+                continue;
+            }
+            if (
+                current.num_intra_threads == config.num_intra_threads
+                 && current.num_inter_threads == config.num_inter_threads
+                 && current.num_replicas == config.num_replicas
+                 && current.num_crops == config.num_crops
+            ) {
+                keep_pool = pool_idx;
+                break;
+            }
+            if (replace_pool == -1) {
+                replace_pool = pool_idx;
+            }
+        }
+
+        if (keep_pool != -1) {
+            SessionConfig& current = pool_configs[keep_pool];
+            if (
+                current.weight != config.weight
+                 || current.temperature != config.temperature
+                 || current.threshold != config.threshold
+            ) {
+                num_updated++;
+            }
+            matched[keep_pool] = 1;
+            pool_configs[keep_pool] = config;
+            pool_temperatures[keep_pool] = config.temperature;
+            pool_thresholds[keep_pool] = config.threshold;
+            for (auto session_idx : pool_sessions[keep_pool]) {
+                session_weights[session_idx] = config.weight;
+            }
+            new_order.push_back(keep_pool);
+            continue;
+        }
+
+        // sessions are created unloaded so the frame loop is not stalled by ORT session construction
+        int pool_idx = add_pool(config, simulator == nullptr);
+        if (pool_idx >= matched.size()) {
+            matched.resize(pool_idx + 1, 0);
+        }
+        matched[pool_idx] = 1;
+        for (auto session_idx : pool_sessions[pool_idx]) {
+            if (!input_image_path.empty()) {
+                sessions[session_idx]->load_input(input_image_path, input_batch_size);
+            }
+            session_pending_queue.push_back(session_idx);
+        }
+
+        if (replace_pool != -1) {
+            num_replaced++;
+            matched[replace_pool] = 1;
+            pool_successors[replace_pool] = pool_idx;
+            new_order.push_back(replace_pool);
+        }
+        else {
+            num_added++;
+            new_order.push_back(pool_idx);
+        }
+    }
+
+    for (auto pool_idx : pool_order) {
+        if (!matched[pool_idx]) {
+            pool_retired[pool_idx] = 1;
+            num_removed++;
+        }
+    }
+    pool_order = new_order;
+
+    printf("Config reloaded: %d added, %d updated, %d replaced, %d removed\n", num_added, num_updated, num_replaced, num_removed);
+}
+
+// Pending sessions join the ready queue once loaded (one load at a time, as with lazy loading).
+// A successor pool joins as a whole once all of its sessions are loaded, in the same frame as
+// its predecessor is retired, so a model never runs in both pools within a frame.
+void InferenceScheduler::apply_pending_sessions() {
+    std::vector<int> successor_pools;
+    for (auto pool_idx : pool_order) {
+        if (pool_successors[pool_idx] != -1) {
+            successor_pools.push_back(pool_successors[pool_idx]);
+        }
+    }
+
+    for (int i = 0; i < session_pending_queue.size(); ) {
+        int session_idx = session_pending_queue[i];
+        if (simulator != nullptr && !session_profiled[session_idx]) {
+            InferenceSession* session = sessions[session_idx];
+            session_inference_times[session_idx] = simulator->get_expected_latency(
+                session->get_model_path(), session->get_num_intra_threads(), session->get_num_inter_threads(),
+                session->get_num_crops()
+            );
+            session_profiled[session_idx] = 1;
+        }
+
+        int is_successor = std::find(successor_pools.begin(), successor_pools.end(), session_pools[session_idx]) != successor_pools.end();
+        if (!is_successor && !is_retired(session_idx) && session_available(session_idx)) {
+            PRINT_THREAD_MAIN("Session added: " << sessions[session_idx]->get_instance_name());
+            session_pending_queue.erase(session_pending_queue.begin() + i);
+            session_ready_queue.push_back(session_idx);
+        }
+        else {
+            i++;
+        }
+    }
+
+    for (auto& pool_idx : pool_order) {
+        int successor = pool_successors[pool_idx];
+        if (successor == -1) {
+            continue;
+        }
+
+        int num_available = 0;
+        for (auto session_idx : pool_sessions[successor]) {
+            num_available += session_available(session_idx);
+        }
+        if (num_available == pool_sessions[successor].size()) {
+            for (auto session_idx : pool_sessions[successor]) {
+                PRINT_THREAD_MAIN("Session added: " << sessions[session_idx]->get_instance_name());
+                session_pending_queue.erase(std::remove(session_pending_queue.begin(), session_pending_queue.end(), session_idx), session_pending_queue.end());
+                session_ready_queue.push_back(session_idx);
+            }
+            PRINT_THREAD_MAIN("Pool " << pool_idx << " replaced by pool " << successor);
+            pool_retired[pool_idx] = 1;
+            pool_successors[pool_idx] = -1;
+            pool_idx = successor;
+        }
+    }
+}
+
+// Retired sessions leave the idle queues right away; running ones are freed once they are done.
+// A freed session is deleted and its slot left for the next added pool.
+void InferenceScheduler::drain_retired_sessions() {
+    auto retired = [this](int session_idx) { return is_retired(session_idx); };
+    session_ready_queue.erase(std::remove_if(session_ready_queue.begin(), session_ready_queue.end(), retired), session_ready_queue.end());
+    session_spare_queue.erase(std::remove_if(session_spare_queue.begin(), session_spare_queue.end(), retired), session_spare_queue.end());
+    session_pending_queue.erase(std::remove_if(session_pending_queue.begin(), session_pending_queue.end(), retired), session_pending_queue.end());
+
+    for (int session_idx = 0; session_idx < sessions.size(); session_idx++) {
+        if (sessions[session_idx] == nullptr || !is_retired(session_idx)) {
+            continue;
+        }
+
+        auto in_queue = [session_idx](const std::vector<int>& queue) {
+            return std::find(queue.begin(), queue.end(), session_idx) != queue.end();
+        };
+        if (in_queue(session_unready_queue) || in_queue(session_inference_queue) || in_queue(session_span_queue)) {
+            continue;
+        }
+
+        // a worker thread may still post the completion after clearing flag_infer
+        InferenceSession* session = sessions[session_idx];
+        if (session->has_workers() || (simulator == nullptr && session->get_load_state() == SESSION_LOAD_LOADING)) {
+            continue;
+        }
+        // cascade stages run outside the queues above; a simulated run is freed with its event
+        if (session->get_flag_infer() || (simulator != nullptr && simulator->has_pending_event(session))) {
+            continue;
+        }
+        if (simulator == nullptr && session->is_loaded() && session->unload_model() != 0) {
+            continue;
+        }
+
+        PRINT_THREAD_MAIN("Session removed: " << session->get_instance_name());
+        metrics_registry.unregister_session(session->get_metrics());
+        std::vector<int>& pool = pool_sessions[session_pools[session_idx]];
+        pool.erase(std::remove(pool.begin(), pool.end(), session_idx), pool.end());
+        if (loading_session == session_idx) {
+            loading_session = -1;
+        }
+        std::string model_path = session->get_model_path();
+        delete session;
+        sessions[session_idx] = nullptr;
+        free_session_slots.push_back(session_idx);
+        release_unused_model(model_path);
+    }
+}
+
 void InferenceScheduler::load_input(const std::string& image_path, int batch_size) {
+    this->input_image_path = image_path;
+    this->input_batch_size = batch_size;
     for (auto session : sessions) {
-        session->load_input(image_path, batch_size);
+        if (session != nullptr) {
+            session->load_input(image_path, batch_size);
+        }
     }
 }
 
 void InferenceScheduler::print_results() {
     for (auto session : sessions) {
+        if (session == nullptr) {
+            continue;
+        }
         printf("<Instance Name: %s>\n", session->get_instance_name().c_str());
         session->print_results();
     }
@@ -92,11 +599,61 @@ void InferenceScheduler::print_results() {
 void InferenceScheduler::benchmark(int num_runs, int num_warmup_runs) {
     std::cout << "Benchmarking sessions" << std::endl;
 
+    int num_benchmarked = 0;
+    std::vector<int64_t> stored_freqs;
     for (int snum = 0; snum < sessions.size(); snum++) {
         InferenceSession* session = sessions[snum];
+        if (session == nullptr) {
+            continue;
+        }
+
+        // replicas run the same model with the same threads
+        int first_replica = pool_sessions[session_pools[snum]].front();
+        if (first_replica != snum) {
+            session_inference_times[snum] = session_inference_times[first_replica];
+            std::cout << session->get_instance_name() << " (" << session_inference_times[snum] << " ms, replica)" << std::endl;
+            continue;
+        }
+
+        if (!session->is_loaded()) {
+            std::cout << session->get_instance_name() << " (deferred until loaded)" << std::endl;
+            continue;
+        }
+        session_profiled[snum] = 1;
+
+        if (simulator != nullptr) {
+            session_inference_times[snum] = simulator->get_expected_latency(
+                session->get_model_path(), session->get_num_intra_threads(), session->get_num_inter_threads(),
+                session->get_num_crops()
+            );
+            std::cout << session->get_instance_name() << " (" << session_inference_times[snum] << " ms, simulated)" << std::endl;
+            continue;
+        }
+
+        // warmup still runs on a stored profile, the first frames would pay for it otherwise
+        int64_t resident_before = get_resident_memory_bytes();
         for (int i = 0; i < num_warmup_runs; i++) {
             session->infer_sync();
         }
+        session_warmup_bytes[snum] = get_resident_memory_bytes() - resident_before;
+
+        // operator profiling needs the runs themselves, and its overhead keeps them out of the store
+        int profiled_ops = !profile_path.empty() && !profiles_reported;
+        const ProfileRecord* record = nullptr;
+        if (profile_store != nullptr && !profiled_ops) {
+            record = profile_store->find(
+                session->get_model_path(), session->get_num_intra_threads(), session->get_num_inter_threads(),
+                session->get_num_crops()
+            );
+        }
+        if (record != nullptr) {
+            if (stored_freqs.empty() && record->num_policies > 0) {
+                stored_freqs.assign(record->ref_freqs_khz, record->ref_freqs_khz + record->num_policies);
+            }
+            session_inference_times[snum] = (int64_t)record->latency_ms;
+            std::cout << session->get_instance_name() << " (" << session_inference_times[snum] << " ms, stored)" << std::endl;
+            continue;
+        }
 
         auto start = std::chrono::high_resolution_clock::now();
         for (int i = 0; i < num_runs; i++) {
@@ -105,19 +662,94 @@ void InferenceScheduler::benchmark(int num_runs, int num_warmup_runs) {
         auto end = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
         session_inference_times[snum] = duration / num_runs;
+        num_benchmarked++;
+        if (profile_store != nullptr && !profiled_ops) {
+            profile_store->put(
+                session->get_model_path(), session->get_num_intra_threads(), session->get_num_inter_threads(),
+                session->get_num_crops(), (float)duration / num_runs, num_runs, session_warmup_bytes[snum],
+                thermal_monitor != nullptr ? thermal_monitor->read_freqs() : std::vector<int64_t>()
+            );
+        }
 
         std::cout << session->get_instance_name() << " (" << session_inference_times[snum] << " ms)" << std::endl;
     }
+
+    if (profile_store != nullptr && simulator == nullptr) {
+        profile_store->save();
+        printf(
+            " - Profile store: %d stored, %d benchmarked, %d records\n",
+            profile_store->get_num_hits(), profile_store->get_num_misses(), profile_store->get_num_records()
+        );
+    }
+
+    // the latencies above hold for the caps the cores ran at when they were measured, which
+    // for stored profiles is an earlier run
+    if (thermal_monitor != nullptr && simulator == nullptr) {
+        if (num_benchmarked == 0 && !stored_freqs.empty()) {
+            thermal_monitor->set_reference(stored_freqs);
+        }
+        else {
+            thermal_monitor->mark_reference();
+        }
+    }
+
+    if (!profile_path.empty() && !profiles_reported) {
+        report_operator_profiles(num_runs);
+    }
+}
+
+// Ends profiling of every pool and reports the benchmark runs (warmup excluded) by operator.
+void InferenceScheduler::report_operator_profiles(int num_runs) {
+    profiles_reported = 1;
+    if (simulator != nullptr) {
+        printf("Operator profiling skipped: sessions are simulated\n");
+        return;
+    }
+
+    std::ofstream tsv_file(profile_path);
+    if (!tsv_file.is_open()) {
+        std::cerr << "Failed to open operator profile: " << profile_path << std::endl;
+        return;
+    }
+    tsv_file << PROFILE_TSV_HEADER << std::endl;
+
+    for (auto pool_idx : pool_order) {
+        InferenceSession* session = sessions[pool_sessions[pool_idx].front()];
+        std::string trace_path = session->end_profiling();
+        if (trace_path.empty()) {
+            continue;
+        }
+
+        OperatorProfile profile;
+        if (profile.load(trace_path, num_runs) != 0) {
+            continue;
+        }
+        printf(
+            "<Operator Profile: %s (%d, %d threads)>\n",
+            session->get_model_path().c_str(), session->get_num_intra_threads(), session->get_num_inter_threads()
+        );
+        printf(" - Trace: %s\n", trace_path.c_str());
+        profile.print_top(profile_top_n);
+        profile.write_tsv(tsv_file, session->get_model_path(), session->get_num_intra_threads(), session->get_num_inter_threads());
+    }
+    printf(" - Operator profile: %s\n", profile_path.c_str());
 }
 
 void InferenceScheduler::infer(int64_t deadline_ts) {
-    int64_t start_ts = get_current_time_milliseconds();
+    if (cascade) {
+        infer_cascade(deadline_ts);
+        return;
+    }
+
+    int64_t start_ts = get_current_time();
+    collect_span_sessions();
 
     while (true) {
         if (
             session_unready_queue.empty()
              && session_ready_queue.empty()
              && session_inference_queue.empty()
+             && !span_sessions_due(deadline_ts)
         ) {
             PRINT_THREAD_MAIN("All sessions finished");
             break;
@@ -125,31 +757,38 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
 
         // check if the session can be started
         // 1) exist check: if there's no session in the ready queue, cannot start
-        // 1) thread check: if the session starts, the number of using threads should be less than max_threads
+        // 1) thread check: if the session starts, the number of using threads should be less than thread_budget
         // 2) deadline check: if the session ends, the expected end time should be less than the deadline
         int flag_start = 1;
+        int flag_span = 0;
         int session_idx = -1;
         int session_num_threads = 0;
         InferenceSession* session = nullptr;
 
-        if (session_ready_queue.empty()) {
+        // sessions still being loaded are passed over, the rest keep the queue order
+        int ready_pos = 0;
+        while (ready_pos < session_ready_queue.size() && !session_available(session_ready_queue[ready_pos])) {
+            ready_pos++;
+        }
+
+        if (ready_pos == session_ready_queue.size()) {
             PRINT_THREAD_MAIN("No session in the ready queue");
             flag_start = 0;
         }
         else {
-            session_idx = session_ready_queue.front();
+            session_idx = session_ready_queue[ready_pos];
             session = sessions[session_idx];
             PRINT_THREAD_MAIN("Checking session: " << session->get_instance_name());
 
             session_num_threads = session->get_num_intra_threads() * session->get_num_inter_threads();
-            if (threads_using + session_num_threads > max_threads) {
-                PRINT_THREAD_MAIN("May exceed thread limit: " << threads_using + session_num_threads << " > " << max_threads);
+            if (threads_using + session_num_threads > thread_budget) {
+                PRINT_THREAD_MAIN("May exceed thread limit: " << threads_using + session_num_threads << " > " << thread_budget);
                 flag_start = 0;
             }
 
-            int64_t now_ts = get_current_time_milliseconds();
+            int64_t now_ts = get_current_time();
             int64_t elapsed_ms = now_ts - start_ts;
-            float expected_latency_ms = session_inference_times[session_idx] * lagging;
+            float expected_latency_ms = expected_latency(session_idx);
             float expected_end_time_ms = elapsed_ms + expected_latency_ms;
             PRINT_THREAD_MAIN(
                 "Elapsed " << elapsed_ms << " ms, " << 
@@ -157,14 +796,23 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
                 "Expected end time " << (elapsed_ms + expected_latency_ms) << " ms"
             );
             if (expected_end_time_ms > deadline_ts - start_ts) {
-                PRINT_THREAD_MAIN("May exceed deadline: " << expected_end_time_ms << " > " << deadline_ts - start_ts);
-                flag_start = 0;
+                // a long model may still run if it can finish within max_frame_age more frames
+                if (max_frame_age > 0 && expected_end_time_ms <= (deadline_ts - start_ts) * (max_frame_age + 1)) {
+                    PRINT_THREAD_MAIN("Spanning frames: " << expected_end_time_ms << " > " << deadline_ts - start_ts);
+                    flag_span = 1;
+                }
+                else {
+                    PRINT_THREAD_MAIN("May exceed deadline: " << expected_end_time_ms << " > " << deadline_ts - start_ts);
+                    flag_start = 0;
+                }
             }
         }
 
         if (flag_start == 1) {
             // start session
             threads_using += session_num_threads;
+            metrics_registry.set_threads_in_use(threads_using);
+            session_launch_times[session_idx] = get_current_time();
             int ret = session->infer_async();
 
             if (ret != 0) {
@@ -172,8 +820,16 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
             }
             else {
                 PRINT_THREAD_MAIN("Session started: " << session->get_instance_name());
-                session_ready_queue.erase(session_ready_queue.begin());
-                session_inference_queue.push_back(session_idx);
+                session_ready_queue.erase(session_ready_queue.begin() + ready_pos);
+                if (flag_span) {
+                    session_span_queue.push_back(session_idx);
+                    session_launch_frames[session_idx] = frame_index;
+                    session_span_deadlines[session_idx] = start_ts + (deadline_ts - start_ts) * (max_frame_age + 1);
+                }
+                else {
+                    session_inference_queue.push_back(session_idx);
+                }
+                mark_session_used(session_idx);
             }
 
         }
@@ -183,10 +839,7 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
             }
 
             // wait for any session to finish
-            pthread_mutex_lock(&any_finished_mutex);
-            struct timespec deadline_as_timespec = timepoint_to_timespec(deadline_ts);
-            int ret = pthread_cond_timedwait(&any_finished_cond, &any_finished_mutex, &deadline_as_timespec);
-            pthread_mutex_unlock(&any_finished_mutex);
+            int ret = wait_any_finished(deadline_ts);
             
             if (ret == 0) {
                 PRINT_THREAD_MAIN("Any session finished");
@@ -200,9 +853,13 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
                 
                 if (session->get_state() == SESSION_STATE_ZOMBIE) {
                     PRINT_THREAD_MAIN("Session ready: " << session->get_instance_name());
+                    trace_latency(session_idx);
 
                     session_unready_queue.erase(session_unready_queue.begin() + session_iter);
-                    session_ready_queue.push_back(session_idx);
+                    if (!is_retired(session_idx)) {
+                        session_ready_queue.push_back(session_idx);
+                    }
+                    balance_replicas();
                 }
                 else {
                     session_iter++;
@@ -223,13 +880,12 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
                     int64_t finish_time_ts = session->get_finish_time();
                     int64_t latency = finish_time_ts - start_ts;
                     PRINT_THREAD_MAIN("Session finished: " << session->get_instance_name() << " (" << latency << " ms)");
+                    trace_latency(session_idx);
 
-                    // calc lagging
-                    float now_lagging = (float)latency / (float)session_inference_times[session_idx];
-                    float new_lagging = lagging * 0.9 + now_lagging * 0.1;
-                    lagging = new_lagging;
+                    update_lagging(session_idx, latency);
 
                     threads_using -= session->get_num_intra_threads() * session->get_num_inter_threads();
+                    metrics_registry.set_threads_in_use(threads_using);
                     session_inference_queue.erase(session_inference_queue.begin() + session_iter);
                     session_finished_queue.push_back(session_idx);
                 }
@@ -242,6 +898,8 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
                 }
             }
 
+            collect_span_sessions();
+
             // sort ready queue by the session index
             std::sort(session_ready_queue.begin(), session_ready_queue.end());
 
@@ -264,8 +922,47 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
         }
     }
 
-    int64_t end_ts = get_current_time_milliseconds();
+    int64_t end_ts = get_current_time();
     int64_t elapsed_ms = end_ts - start_ts;
+
+    push_frame_stats(FrameStats{
+        start_ts, end_ts, deadline_ts,
+        (int)(session_finished_queue.size() + session_inference_queue.size()),
+        (int)session_finished_queue.size(),
+        0, (int)aged_results.size()
+    });
+
+    std::vector<int> finished_idxs;
+    std::vector<const float*> finished_logits;
+    std::vector<int> frame_ages;
+    for (auto session_idx : session_finished_queue) {
+        const float* logits = sessions[session_idx]->get_output_data();
+        if (logits != nullptr) {
+            finished_idxs.push_back(session_idx);
+            finished_logits.push_back(logits);
+            frame_ages.push_back(0);
+        }
+    }
+    for (auto& aged : aged_results) {
+        if (aged.logit_row >= 0) {
+            finished_idxs.push_back(aged.session_idx);
+            finished_logits.push_back(aged_logits.data() + (size_t)aged.logit_row * labels.size());
+            frame_ages.push_back(aged.frame_age);
+        }
+    }
+    postprocess_frame(0, finished_idxs, finished_logits, frame_ages);
+
+    if (result_sink != nullptr) {
+        std::vector<int64_t> finished_latencies;
+        for (auto session_idx : session_finished_queue) {
+            finished_latencies.push_back(sessions[session_idx]->get_finish_time() - start_ts);
+        }
+        emit_frame_record(frame_stats.back(), pool_order, session_finished_queue, finished_latencies, aged_results);
+    }
+
+    if (!verbose) {
+        return;
+    }
     
     std::cout << "Elapsed time: " << elapsed_ms << " ms (lagging: " << lagging << ")" << std::endl;
     printf("Finished sessions:\n");
@@ -274,26 +971,247 @@ void InferenceScheduler::infer(int64_t deadline_ts) {
         int64_t latency = finish_time - start_ts;
         std::cout << "\t" << sessions[session_idx]->get_instance_name() << " (" << latency << " ms)" << std::endl;
     }
+    if (!aged_results.empty()) {
+        printf("Aged sessions:\n");
+        for (auto& aged : aged_results) {
+            std::cout << "\t" << sessions[aged.session_idx]->get_instance_name() << " (" << aged.latency_ms << " ms, "
+                << aged.frame_age << " frame(s) old)" << std::endl;
+        }
+    }
+    if (!frame_result.ensemble_top_k.empty()) {
+        const Prediction& top = frame_result.ensemble_top_k[0];
+        std::cout << "Ensemble prediction: " << labels[top.label_id] << " (" << top.probability << ")" << std::endl;
+    }
 }
 
-void InferenceScheduler::reset_inference() {
-    pthread_mutex_init(&any_finished_mutex, NULL);
-    pthread_cond_init(&any_finished_cond, NULL);
+// Runs the pools one after another as cascade stages. Each stage is launched only if it is
+// expected to finish before the deadline; the frame exits at the first stage whose calibrated
+// confidence reaches the stage threshold. Simulated runs have no logits and always escalate.
+void InferenceScheduler::infer_cascade(int64_t deadline_ts) {
+    int64_t start_ts = get_current_time();
+    CascadeFrame frame{-1, 0, 0, 0, deadline_ts - start_ts, -1, 0.0f};
+    int num_finished = 0;
+    std::vector<int> stage_pools;
+    std::vector<int> finished_sessions;
+    std::vector<int64_t> finished_latencies;
 
-    for (auto session : sessions) {
-        session->reset_state();
-    }
+    for (auto stage : pool_order) {
+        int session_idx = find_idle_replica(stage);
+        if (session_idx == -1) {
+            PRINT_THREAD_MAIN("Cascade stage " << stage << " unavailable");
+            continue;
+        }
+        InferenceSession* session = sessions[session_idx];
 
-    threads_using = 0;
+        float expected_latency_ms = expected_latency(session_idx);
+        if (get_current_time() + expected_latency_ms > deadline_ts) {
+            PRINT_THREAD_MAIN("May exceed deadline: cascade stops before stage " << stage);
+            break;
+        }
 
-    session_unready_queue.insert(session_unready_queue.end(), session_inference_queue.begin(), session_inference_queue.end());
-    session_inference_queue.clear();
-    session_ready_queue.insert(session_ready_queue.end(), session_finished_queue.begin(), session_finished_queue.end());
-    session_finished_queue.clear();
+        session_launch_times[session_idx] = get_current_time();
+        uint32_t launch_seq = completion_signal.get_seq(session_idx);
+        if (session->infer_async() != 0) {
+            // still running a canceled run of an earlier frame
+            PRINT_THREAD_MAIN("Failed to start session: " << session->get_instance_name());
+            continue;
+        }
+        mark_session_used(session_idx);
+        stage_pools.push_back(stage);
+        frame.num_stages++;
 
-    lagging = 1.0;
-    
-    PRINT_THREAD_MAIN("Inference reset");
+        if (wait_session_finished(session_idx, launch_seq, deadline_ts) != 0) {
+            PRINT_THREAD_MAIN("Deadline exceeded in cascade stage " << stage);
+            break;
+        }
+
+        int64_t latency = session->get_finish_time() - session_launch_times[session_idx];
+        trace_latency(session_idx);
+        update_lagging(session_idx, latency);
+        frame.compute_ms += latency;
+        frame.thread_ms += latency * session->get_num_intra_threads() * session->get_num_inter_threads();
+        frame.exit_stage = stage;
+        finished_sessions.push_back(session_idx);
+        finished_latencies.push_back(session->get_finish_time() - start_ts);
+        num_finished++;
+
+        const float* logits = session->get_output_data();
+        if (logits == nullptr) {
+            continue;
+        }
+
+        stage_probs.resize(labels.size());
+        softmax_stable(logits, stage_probs.data(), labels.size(), pool_temperatures[stage]);
+        int top = std::max_element(stage_probs.begin(), stage_probs.end()) - stage_probs.begin();
+        frame.label_id = top;
+        frame.confidence = stage_probs[top];
+        PRINT_THREAD_MAIN("Cascade stage " << stage << ": " << labels[top] << " (" << frame.confidence << ")");
+
+        if (frame.confidence >= pool_thresholds[stage]) {
+            break;
+        }
+    }
+
+    int64_t end_ts = get_current_time();
+    cascade_frames.push_back(frame);
+    push_frame_stats(FrameStats{
+        start_ts, end_ts, deadline_ts,
+        frame.num_stages, num_finished,
+        0, 0
+    });
+
+    // the frame's prediction is the exit stage alone
+    std::vector<int> exit_sessions;
+    std::vector<const float*> exit_logits;
+    if (!finished_sessions.empty() && sessions[finished_sessions.back()]->get_output_data() != nullptr) {
+        exit_sessions.push_back(finished_sessions.back());
+        exit_logits.push_back(sessions[finished_sessions.back()]->get_output_data());
+    }
+    postprocess_frame(0, exit_sessions, exit_logits, std::vector<int>(exit_sessions.size(), 0));
+
+    if (result_sink != nullptr) {
+        emit_frame_record(frame_stats.back(), stage_pools, finished_sessions, finished_latencies, std::vector<AgedResult>());
+    }
+
+    if (!verbose) {
+        return;
+    }
+
+    std::cout << "Elapsed time: " << end_ts - start_ts << " ms, cascade exit at stage " << frame.exit_stage
+        << " (" << frame.compute_ms << " ms of compute)" << std::endl;
+    if (frame.label_id >= 0) {
+        std::cout << "Cascade prediction: " << labels[frame.label_id] << " (" << frame.confidence << ")" << std::endl;
+    }
+}
+
+// Softmax and top-k of every finished session in one batch, fused by the config weights.
+void InferenceScheduler::postprocess_frame(
+    int stream_id, const std::vector<int>& session_idxs,
+    const std::vector<const float*>& logits, const std::vector<int>& frame_ages
+) {
+    frame_result.stream_id = stream_id;
+    frame_result.session_idxs = session_idxs;
+    frame_result.session_frame_ages = frame_ages;
+    frame_result.session_top_k.resize(session_idxs.size());
+    frame_result.ensemble_top_k.clear();
+    if (session_idxs.empty()) {
+        return;
+    }
+
+    frame_weights.clear();
+    frame_temperatures.clear();
+    for (auto session_idx : session_idxs) {
+        frame_weights.push_back(session_weights[session_idx]);
+        frame_temperatures.push_back(pool_temperatures[session_pools[session_idx]]);
+    }
+
+    postprocessor.process(logits, frame_weights, labels.size(), frame_temperatures);
+    for (int row = 0; row < session_idxs.size(); row++) {
+        frame_result.session_top_k[row] = postprocessor.get_top_k(row);
+    }
+    frame_result.ensemble_top_k = postprocessor.get_ensemble_top_k();
+}
+
+// Copies the frame into a fixed-size record for the result sink; formatting happens on the writer thread.
+void InferenceScheduler::emit_frame_record(
+    const FrameStats& stats, const std::vector<int>& pool_idxs,
+    const std::vector<int>& finished_sessions, const std::vector<int64_t>& finished_latencies,
+    const std::vector<AgedResult>& aged
+) {
+    FrameRecord record;
+    record.frame_id = next_frame_id++;
+    record.stream_id = stats.stream_id;
+    record.start_ts = stats.start_ts;
+    record.end_ts = stats.end_ts;
+    record.deadline_ts = stats.deadline_ts;
+    record.num_launched = stats.num_launched;
+    record.num_finished = stats.num_finished;
+    record.finished_pool_mask = 0;
+    record.missed_pool_mask = 0;
+    record.aged_pool_mask = 0;
+    std::fill(record.pool_latency_ms, record.pool_latency_ms + RESULT_MAX_POOLS, -1);
+    std::fill(record.pool_frame_age, record.pool_frame_age + RESULT_MAX_POOLS, 0);
+
+    for (int i = 0; i < finished_sessions.size(); i++) {
+        int pool_idx = session_pools[finished_sessions[i]];
+        if (pool_idx < RESULT_MAX_POOLS && finished_latencies[i] <= stats.deadline_ts - stats.start_ts) {
+            record.finished_pool_mask |= 1u << pool_idx;
+            record.pool_latency_ms[pool_idx] = finished_latencies[i];
+        }
+    }
+    for (auto& result : aged) {
+        int pool_idx = session_pools[result.session_idx];
+        if (pool_idx < RESULT_MAX_POOLS) {
+            record.finished_pool_mask |= 1u << pool_idx;
+            record.aged_pool_mask |= 1u << pool_idx;
+            record.pool_latency_ms[pool_idx] = result.latency_ms;
+            record.pool_frame_age[pool_idx] = result.frame_age;
+        }
+    }
+    for (auto pool_idx : pool_idxs) {
+        if (pool_idx < RESULT_MAX_POOLS && !(record.finished_pool_mask & (1u << pool_idx))) {
+            record.missed_pool_mask |= 1u << pool_idx;
+        }
+    }
+
+    record.num_predictions = std::min((int)frame_result.ensemble_top_k.size(), RESULT_TOP_K);
+    for (int i = 0; i < record.num_predictions; i++) {
+        record.label_ids[i] = frame_result.ensemble_top_k[i].label_id;
+        record.probabilities[i] = frame_result.ensemble_top_k[i].probability;
+    }
+
+    result_sink->push(record);
+}
+
+void InferenceScheduler::reset_inference() {
+    // results of spanning runs that arrived since the last frame belong to the new one
+    frame_index++;
+    aged_results.clear();
+    aged_logits.clear();
+    collect_span_sessions();
+
+    // spanning runs that can no longer make their span deadline are canceled like the rest
+    int64_t now_ts = get_current_time();
+    for (int i = 0; i < session_span_queue.size(); ) {
+        int session_idx = session_span_queue[i];
+        if (session_span_deadlines[session_idx] <= now_ts) {
+            session_span_queue.erase(session_span_queue.begin() + i);
+            session_inference_queue.push_back(session_idx);
+        }
+        else {
+            i++;
+        }
+    }
+
+    threads_using = 0;
+    for (int session_idx = 0; session_idx < sessions.size(); session_idx++) {
+        InferenceSession* session = sessions[session_idx];
+        if (session == nullptr) {
+            continue;
+        }
+        if (std::find(session_span_queue.begin(), session_span_queue.end(), session_idx) != session_span_queue.end()) {
+            threads_using += session->get_num_intra_threads() * session->get_num_inter_threads();
+            continue;
+        }
+        session->reset_state();
+    }
+    metrics_registry.set_threads_in_use(threads_using);
+
+    session_unready_queue.insert(session_unready_queue.end(), session_inference_queue.begin(), session_inference_queue.end());
+    session_inference_queue.clear();
+    session_ready_queue.insert(session_ready_queue.end(), session_finished_queue.begin(), session_finished_queue.end());
+    session_finished_queue.clear();
+    apply_pending_sessions();
+    drain_retired_sessions();
+    balance_replicas();
+
+    usage_clock++;
+    evict_sessions();
+
+    lagging = 1.0;
+    update_thermal_state();
+    
+    PRINT_THREAD_MAIN("Inference reset");
     PRINT_THREAD_MAIN("QUEUE (unready): " << session_unready_queue);
     PRINT_THREAD_MAIN("QUEUE (ready): " << session_ready_queue);
     PRINT_THREAD_MAIN("QUEUE (inference): " << session_inference_queue);
@@ -301,8 +1219,739 @@ void InferenceScheduler::reset_inference() {
 
 }
 
+// Benchmark latency at the current frequency, times the lagging observed in this frame.
+float InferenceScheduler::expected_latency(int session_idx) {
+    return session_inference_times[session_idx] * freq_scale * lagging;
+}
+
+// Lagging only tracks what the frequency scale does not explain, e.g. memory contention.
+void InferenceScheduler::update_lagging(int session_idx, int64_t latency) {
+    float now_lagging = (float)latency / (session_inference_times[session_idx] * freq_scale);
+    lagging = lagging * 0.9 + now_lagging * 0.1;
+}
+
+// Samples cpufreq and the thermal zones at most every THERMAL_SAMPLE_INTERVAL_MS. Within
+// thermal_guard_c of the trip point the thread budget shrinks linearly with the headroom, so
+// the lowest priority models are dropped before the kernel throttles; the first active pool
+// always keeps enough threads to run.
+void InferenceScheduler::update_thermal_state() {
+    if (thermal_monitor == nullptr) {
+        return;
+    }
+
+    int64_t now_ts = get_current_time();
+    if (thermal_sample_ts >= 0 && now_ts - thermal_sample_ts < THERMAL_SAMPLE_INTERVAL_MS) {
+        return;
+    }
+    thermal_sample_ts = now_ts;
+
+    ThermalState state = thermal_monitor->sample();
+    freq_scale = state.freq_scale;
+
+    int min_budget = 1;
+    if (!pool_order.empty()) {
+        InferenceSession* first = sessions[pool_sessions[pool_order.front()].front()];
+        min_budget = first->get_num_intra_threads() * first->get_num_inter_threads();
+    }
+
+    int new_budget = max_threads;
+    if (state.headroom_c < thermal_guard_c) {
+        new_budget = (int)(max_threads * std::max(state.headroom_c, 0.0) / thermal_guard_c);
+        new_budget = std::min(std::max(new_budget, min_budget), max_threads);
+    }
+    if (new_budget != thread_budget) {
+        PRINT_THREAD_MAIN("Thermal budget: " << thread_budget << " -> " << new_budget << " threads (" << state.temp_c << " C, headroom " << state.headroom_c << " C)");
+        thread_budget = new_budget;
+    }
+
+    thermal_max_freq_scale = std::max(thermal_max_freq_scale, freq_scale);
+    thermal_max_temp_c = std::max(thermal_max_temp_c, state.temp_c);
+    metrics_registry.set_thermal_state(thread_budget, freq_scale, state.temp_c);
+}
+
+// Spanning runs whose result belongs to the frame ending at deadline_ts at the latest.
+int InferenceScheduler::span_sessions_due(int64_t deadline_ts) {
+    for (auto session_idx : session_span_queue) {
+        if (session_span_deadlines[session_idx] <= deadline_ts) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Moves finished spanning runs out of the span queue. A result that made its span deadline is kept
+// (logits copied) for the current frame; the session is ready again right away.
+void InferenceScheduler::collect_span_sessions() {
+    int num_collected = 0;
+    for (int i = 0; i < session_span_queue.size(); ) {
+        int session_idx = session_span_queue[i];
+        InferenceSession* session = sessions[session_idx];
+        if (session->get_state() != SESSION_STATE_FINISHED) {
+            i++;
+            continue;
+        }
+
+        int64_t finish_time_ts = session->get_finish_time();
+        int64_t latency = finish_time_ts - session_launch_times[session_idx];
+        trace_latency(session_idx);
+
+        update_lagging(session_idx, latency);
+
+        if (finish_time_ts <= session_span_deadlines[session_idx]) {
+            int logit_row = -1;
+            const float* logits = session->get_output_data();
+            if (logits != nullptr) {
+                logit_row = aged_logits.size() / labels.size();
+                aged_logits.insert(aged_logits.end(), logits, logits + labels.size());
+            }
+            aged_results.push_back(AgedResult{session_idx, frame_index - session_launch_frames[session_idx], latency, logit_row});
+            PRINT_THREAD_MAIN("Spanning session finished: " << session->get_instance_name() << " (" << latency << " ms)");
+        }
+        else {
+            PRINT_THREAD_MAIN("Spanning session too late: " << session->get_instance_name() << " (" << latency << " ms)");
+        }
+
+        threads_using -= session->get_num_intra_threads() * session->get_num_inter_threads();
+        metrics_registry.set_threads_in_use(threads_using);
+        session_span_queue.erase(session_span_queue.begin() + i);
+        session->set_state(SESSION_STATE_IDLE);
+        if (!is_retired(session_idx)) {
+            session_ready_queue.push_back(session_idx);
+        }
+        num_collected++;
+    }
+
+    if (num_collected > 0) {
+        balance_replicas();
+    }
+}
+
 void InferenceScheduler::enqueue_inference_naive() {
     for (int i = 0; i < sessions.size(); i++) {
         session_ready_queue.push_back(i);
     }
+}
+
+// Keeps at most one replica of each pool in the ready queue; the other idle replicas wait
+// in the spare queue. A pool already running or finished in this frame gets no ready replica.
+void InferenceScheduler::balance_replicas() {
+    std::vector<int> idle_sessions = session_ready_queue;
+    idle_sessions.insert(idle_sessions.end(), session_spare_queue.begin(), session_spare_queue.end());
+    session_ready_queue.clear();
+    session_spare_queue.clear();
+
+    std::vector<int> pool_served(pool_sessions.size(), 0);
+    for (auto session_idx : session_inference_queue) {
+        pool_served[session_pools[session_idx]] = 1;
+    }
+    for (auto session_idx : session_finished_queue) {
+        pool_served[session_pools[session_idx]] = 1;
+    }
+
+    for (auto session_idx : idle_sessions) {
+        int pool_idx = session_pools[session_idx];
+        if (pool_served[pool_idx]) {
+            session_spare_queue.push_back(session_idx);
+        }
+        else {
+            session_ready_queue.push_back(session_idx);
+            pool_served[pool_idx] = 1;
+        }
+    }
+}
+
+int InferenceScheduler::find_idle_replica(int pool_idx) {
+    for (auto session_idx : pool_sessions[pool_idx]) {
+        if (
+            session_owners[session_idx] == -1
+             && sessions[session_idx]->get_state() != SESSION_STATE_INFER
+             && session_available(session_idx)
+        ) {
+            return session_idx;
+        }
+    }
+    return -1;
+}
+
+// Returns 1 if the session can be launched. An unloaded session is loaded in the
+// background on first use, one at a time, and its stored profile (or else its warm
+// latency) stands in for the benchmark until it has one.
+int InferenceScheduler::session_available(int session_idx) {
+    InferenceSession* session = sessions[session_idx];
+    if (is_retired(session_idx)) {
+        return 0;
+    }
+    if (session->is_loaded()) {
+        if (!session_profiled[session_idx]) {
+            const ProfileRecord* record = nullptr;
+            if (profile_store != nullptr && simulator == nullptr) {
+                record = profile_store->lookup(
+                    session->get_model_path(), session->get_num_intra_threads(), session->get_num_inter_threads(),
+                    session->get_num_crops()
+                );
+            }
+            session_inference_times[session_idx] = record != nullptr ? (int64_t)record->latency_ms : session->get_warm_latency();
+            session_profiled[session_idx] = 1;
+        }
+        return 1;
+    }
+
+    if (loading_session != -1 && sessions[loading_session]->get_load_state() == SESSION_LOAD_LOADING) {
+        return 0;
+    }
+    if (session->load_model_async() == 0) {
+        PRINT_THREAD_MAIN("Session loading: " << session->get_instance_name());
+        loading_session = session_idx;
+        session_last_used[session_idx] = usage_clock;
+    }
+    return 0;
+}
+
+void InferenceScheduler::mark_session_used(int session_idx) {
+    session_num_launches[session_idx]++;
+    session_last_used[session_idx] = usage_clock;
+}
+
+// Unloads idle sessions, least recently used and then least launched first, until the
+// resident memory is expected to fit in the budget. Sessions used since the previous
+// frame boundary are kept to avoid thrashing.
+void InferenceScheduler::evict_sessions() {
+    if (!lazy_loading || memory_budget_bytes <= 0) {
+        return;
+    }
+
+    if (get_resident_memory_bytes() <= memory_budget_bytes) {
+        return;
+    }
+
+    std::vector<int> candidates;
+    for (int session_idx = 0; session_idx < sessions.size(); session_idx++) {
+        InferenceSession* session = sessions[session_idx];
+        if (
+            session != nullptr
+             && session->is_loaded()
+             && session->get_state() != SESSION_STATE_INFER
+             && session_owners[session_idx] == -1
+             && session_last_used[session_idx] < usage_clock - 1
+        ) {
+            candidates.push_back(session_idx);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+        if (session_last_used[a] != session_last_used[b]) return session_last_used[a] < session_last_used[b];
+        return session_num_launches[a] < session_num_launches[b];
+    });
+
+    // the resident size is measured again after every eviction; the per-session estimates miss
+    // the shared weights and the arena, and count memory the allocator may keep
+    for (auto session_idx : candidates) {
+        InferenceSession* session = sessions[session_idx];
+        if (session->unload_model() != 0) {
+            continue;
+        }
+        PRINT_THREAD_MAIN("Session evicted: " << session->get_instance_name());
+        release_unused_model(session->get_model_path());
+        release_free_heap();
+        if (get_resident_memory_bytes() <= memory_budget_bytes) {
+            break;
+        }
+    }
+}
+
+// Once no session of the model is loaded or loading, its shared weights and mapping are dropped
+// and the arena is shrunk at the next run.
+void InferenceScheduler::release_unused_model(const std::string& model_path) {
+    if (simulator != nullptr) {
+        return;
+    }
+    for (auto session : sessions) {
+        if (session != nullptr && session->get_model_path() == model_path && session->get_load_state() != SESSION_LOAD_UNLOADED) {
+            return;
+        }
+    }
+    PRINT_THREAD_MAIN("Model released: " << model_path);
+    memory_manager.release_model(model_path);
+    memory_manager.request_arena_shrink();
+}
+
+int InferenceScheduler::wait_any_finished(int64_t deadline_ts) {
+    if (simulator != nullptr) {
+        return simulator->wait_any_finished(deadline_ts);
+    }
+
+    // completions since the last wait are returned at once, none is lost to the scan in between
+    int ret = completion_signal.wait(deadline_ts, completed_slots);
+    PRINT_THREAD_MAIN("Completions: " << completed_slots);
+    return ret;
+}
+
+// Waits for the run launched at launch_seq; the sequence number cannot miss a completion the way a state check could.
+int InferenceScheduler::wait_session_finished(int session_idx, uint32_t launch_seq, int64_t deadline_ts) {
+    InferenceSession* session = sessions[session_idx];
+    if (simulator != nullptr) {
+        while (session->get_state() != SESSION_STATE_FINISHED) {
+            if (simulator->wait_any_finished(deadline_ts) == ETIMEDOUT) {
+                return ETIMEDOUT;
+            }
+        }
+        return 0;
+    }
+
+    // the slot's sequence number moves past launch_seq once this run has completed
+    while (completion_signal.get_seq(session_idx) == launch_seq) {
+        if (completion_signal.wait(deadline_ts, completed_slots) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    return session->get_state() == SESSION_STATE_FINISHED ? 0 : ETIMEDOUT;
+}
+
+int64_t InferenceScheduler::get_current_time() {
+    if (simulator != nullptr) {
+        return simulator->get_current_time();
+    }
+    return get_current_time_milliseconds();
+}
+
+void InferenceScheduler::sleep_until(int64_t timestamp) {
+    if (simulator != nullptr) {
+        simulator->advance_to(timestamp);
+        return;
+    }
+
+    int64_t remaining_ms = timestamp - get_current_time_milliseconds();
+    if (remaining_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(remaining_ms));
+    }
+}
+
+// A frame hits its deadline when every model launched for it finished in time and it got at
+// least one result, either its own or an aged one from a spanning model.
+static int frame_hit(const FrameStats& stats) {
+    return stats.num_finished + stats.num_aged > 0 && stats.num_finished == stats.num_launched;
+}
+
+void InferenceScheduler::push_frame_stats(const FrameStats& stats) {
+    frame_stats.push_back(stats);
+    metrics_registry.record_frame(frame_hit(stats), stats.end_ts);
+    if (thread_budget < max_threads) {
+        thermal_frames_reduced++;
+    }
+}
+
+void InferenceScheduler::print_frame_summary() {
+    if (frame_stats.empty()) {
+        return;
+    }
+
+    int num_streams = std::max((int)streams.size(), 1);
+    for (int stream_id = 0; stream_id < num_streams; stream_id++) {
+        int num_frames = 0, num_hits = 0;
+        int64_t num_launched = 0, num_finished = 0, num_aged = 0;
+        for (auto& stats : frame_stats) {
+            if (stats.stream_id != stream_id) {
+                continue;
+            }
+            if (frame_hit(stats)) {
+                num_hits++;
+            }
+            num_frames++;
+            num_launched += stats.num_launched;
+            num_finished += stats.num_finished;
+            num_aged += stats.num_aged;
+        }
+        if (num_frames == 0) {
+            continue;
+        }
+
+        if (streams.empty()) {
+            printf("<Frame Summary>\n");
+        }
+        else {
+            printf("<Frame Summary: %s>\n", streams[stream_id].name.c_str());
+        }
+        printf(" - Frames: %d\n", num_frames);
+        printf(" - Deadline hit rate: %.2f%% (%d/%d)\n", 100.0 * num_hits / num_frames, num_hits, num_frames);
+        printf(" - Models launched per frame: %.2f\n", (float)num_launched / num_frames);
+        printf(" - Models completed per frame: %.2f\n", (float)num_finished / num_frames);
+        if (max_frame_age > 0) {
+            printf(" - Aged results per frame: %.2f\n", (float)num_aged / num_frames);
+        }
+    }
+
+    if (thermal_monitor != nullptr) {
+        printf("<Thermal Summary>\n");
+        printf(" - Peak temperature: %.1f C\n", thermal_max_temp_c);
+        printf(" - Peak latency scale: %.2f\n", thermal_max_freq_scale);
+        printf(" - Frames with reduced thread budget: %.2f%%\n", 100.0 * thermal_frames_reduced / frame_stats.size());
+    }
+}
+
+void InferenceScheduler::print_cascade_summary() {
+    if (cascade_frames.empty()) {
+        return;
+    }
+
+    // compute of a frame that runs every stage, from the benchmark
+    int64_t full_compute_ms = 0;
+    for (auto pool_idx : pool_order) {
+        full_compute_ms += session_inference_times[pool_sessions[pool_idx].front()];
+    }
+
+    int num_frames = cascade_frames.size();
+    int64_t total_compute_ms = 0, total_thread_ms = 0, total_budget_ms = 0;
+    int num_correct = 0, num_predicted = 0;
+    std::vector<int> stage_exits(pool_sessions.size(), 0);
+    std::vector<int> stage_correct(pool_sessions.size(), 0);
+    for (auto& frame : cascade_frames) {
+        total_compute_ms += frame.compute_ms;
+        total_thread_ms += frame.thread_ms;
+        total_budget_ms += frame.budget_ms;
+        int correct = frame.label_id >= 0 && frame.label_id == ground_truth_id;
+        num_correct += correct;
+        num_predicted += frame.label_id >= 0;
+        if (frame.exit_stage >= 0) {
+            stage_exits[frame.exit_stage]++;
+            stage_correct[frame.exit_stage] += correct;
+        }
+    }
+
+    printf("<Cascade Summary>\n");
+    printf(" - Compute per frame: %.2f ms (%.1f%% of the deadline, %.1f%% of the full cascade)\n",
+        (float)total_compute_ms / num_frames,
+        100.0 * total_compute_ms / std::max(total_budget_ms, (int64_t)1),
+        100.0 * total_compute_ms / std::max(full_compute_ms * num_frames, (int64_t)1));
+    printf(" - Thread time per frame: %.2f ms\n", (float)total_thread_ms / num_frames);
+    if (ground_truth_id >= 0 && num_predicted > 0) {
+        printf(" - Accuracy: %.2f%% (%d/%d)\n", 100.0 * num_correct / num_frames, num_correct, num_frames);
+    }
+    // exit_stage is a pool index, stages are numbered in config order
+    for (int pos = 0; pos < pool_order.size(); pos++) {
+        int stage = pool_order[pos];
+        printf(" - Stage %d (%s, threshold %.2f, temperature %.2f): %.2f%% of frames exit",
+            pos, sessions[pool_sessions[stage].front()]->get_model_path().c_str(),
+            pool_thresholds[stage], pool_temperatures[stage], 100.0 * stage_exits[stage] / num_frames);
+        if (ground_truth_id >= 0 && num_predicted > 0 && stage_exits[stage] > 0) {
+            printf(", accuracy %.2f%%", 100.0 * stage_correct[stage] / stage_exits[stage]);
+        }
+        printf("\n");
+    }
+}
+
+int InferenceScheduler::add_stream(
+    const std::string& name, const std::string& image_path,
+    int64_t deadline_ms, const std::vector<int>& pool_idxs
+) {
+    StreamInfo stream{name, deadline_ms, pool_idxs, {}};
+    if (stream.pool_idxs.empty()) {
+        for (int i = 0; i < pool_sessions.size(); i++) {
+            stream.pool_idxs.push_back(i);
+        }
+    }
+
+    for (auto pool_idx : stream.pool_idxs) {
+        if (pool_idx < 0 || pool_idx >= pool_sessions.size()) {
+            std::cerr << "Invalid model index for stream " << name << ": " << pool_idx << std::endl;
+            exit(1);
+        }
+
+        int input_slot = -1;
+        for (auto session_idx : pool_sessions[pool_idx]) {
+            input_slot = sessions[session_idx]->add_input(image_path);
+        }
+        stream.input_slots.push_back(input_slot);
+    }
+
+    streams.push_back(stream);
+    return streams.size() - 1;
+}
+
+void InferenceScheduler::submit_frame(int stream_id, int64_t arrival_ts) {
+    StreamInfo& stream = streams[stream_id];
+
+    FrameRequest request{next_request_id++, stream_id, arrival_ts, arrival_ts + stream.deadline_ms, {}, 0, 0, 0};
+    for (int i = 0; i < stream.pool_idxs.size(); i++) {
+        request.pending.push_back(i);
+    }
+    active_requests.push_back(request);
+
+    usage_clock++;
+    evict_sessions();
+
+    PRINT_THREAD_MAIN("Frame request " << request.request_id << " from stream " << stream.name << " (deadline " << request.deadline_ts << ")");
+}
+
+// Serves the active frame requests of all streams until until_ts.
+// Sessions are shared: an idle replica is handed to the request with the earliest deadline,
+// ties broken by the least slack, and the thread budget is shared by every stream.
+void InferenceScheduler::serve_requests(int64_t until_ts) {
+    while (true) {
+        collect_stream_sessions();
+
+        int64_t now_ts = get_current_time();
+        for (int i = 0; i < active_requests.size(); ) {
+            FrameRequest& request = active_requests[i];
+            bool done = request.pending.empty() && request.num_running == 0;
+            if (now_ts >= request.deadline_ts || done) {
+                close_request(i);
+            }
+            else {
+                i++;
+            }
+        }
+
+        if (now_ts >= until_ts) {
+            break;
+        }
+
+        launch_stream_sessions();
+
+        // wait for a session to finish, the earliest deadline, or until_ts
+        int64_t wake_ts = until_ts;
+        for (auto& request : active_requests) {
+            wake_ts = std::min(wake_ts, request.deadline_ts);
+        }
+        if (wake_ts == INT64_MAX) {
+            // draining and nothing left to wait for
+            break;
+        }
+        wait_any_finished(wake_ts);
+    }
+}
+
+void InferenceScheduler::serve_streams(int num_frames) {
+    int64_t start_ts = get_current_time();
+    std::vector<int> num_submitted(streams.size(), 0);
+
+    while (true) {
+        int next_stream = -1;
+        int64_t next_arrival_ts = INT64_MAX;
+        for (int stream_id = 0; stream_id < streams.size(); stream_id++) {
+            if (num_submitted[stream_id] >= num_frames) {
+                continue;
+            }
+            int64_t arrival_ts = start_ts + streams[stream_id].deadline_ms * num_submitted[stream_id];
+            if (arrival_ts < next_arrival_ts) {
+                next_stream = stream_id;
+                next_arrival_ts = arrival_ts;
+            }
+        }
+
+        serve_requests(next_arrival_ts);
+        if (next_stream == -1) {
+            break;
+        }
+
+        submit_frame(next_stream, next_arrival_ts);
+        num_submitted[next_stream]++;
+    }
+}
+
+// Open-loop serving: frames arrive at the offsets drawn by each stream's generator whether or not
+// earlier frames are done, so a backlog shows up as queueing delay instead of a slower frame clock.
+void InferenceScheduler::serve_load(const std::vector<LoadGenerator*>& generators, int num_frames) {
+    load_records.clear();
+    serving_load = 1;
+    int64_t start_ts = get_current_time();
+    std::vector<int> num_submitted(streams.size(), 0);
+    std::vector<int64_t> next_offsets(streams.size());
+    for (int stream_id = 0; stream_id < streams.size(); stream_id++) {
+        next_offsets[stream_id] = generators[stream_id]->next_arrival_ms();
+    }
+
+    while (true) {
+        int next_stream = -1;
+        int64_t next_arrival_ts = INT64_MAX;
+        for (int stream_id = 0; stream_id < streams.size(); stream_id++) {
+            if (num_submitted[stream_id] >= num_frames || next_offsets[stream_id] < 0) {
+                continue;
+            }
+            int64_t arrival_ts = start_ts + next_offsets[stream_id];
+            if (arrival_ts < next_arrival_ts) {
+                next_stream = stream_id;
+                next_arrival_ts = arrival_ts;
+            }
+        }
+
+        serve_requests(next_arrival_ts);
+        if (next_stream == -1) {
+            break;
+        }
+
+        submit_frame(next_stream, next_arrival_ts);
+        num_submitted[next_stream]++;
+        next_offsets[next_stream] = generators[next_stream]->next_arrival_ms();
+    }
+    serving_load = 0;
+}
+
+void InferenceScheduler::collect_stream_sessions() {
+    for (int session_idx = 0; session_idx < sessions.size(); session_idx++) {
+        InferenceSession* session = sessions[session_idx];
+        if (session == nullptr || session_owners[session_idx] == -1 || session->get_state() != SESSION_STATE_FINISHED) {
+            continue;
+        }
+
+        int64_t finish_time_ts = session->get_finish_time();
+        int64_t latency = finish_time_ts - session_launch_times[session_idx];
+        trace_latency(session_idx);
+
+        update_lagging(session_idx, latency);
+
+        for (auto& request : active_requests) {
+            if (request.request_id != session_owners[session_idx]) {
+                continue;
+            }
+            request.num_running--;
+            request.last_finish_ts = std::max(request.last_finish_ts, finish_time_ts);
+            if (finish_time_ts <= request.deadline_ts) {
+                request.num_finished++;
+                request.finished_sessions.push_back(session_idx);
+                request.finished_latencies.push_back(finish_time_ts - request.arrival_ts);
+
+                const float* logits = session->get_output_data();
+                if (logits != nullptr) {
+                    request.logit_sessions.push_back(session_idx);
+                    request.finished_logits.insert(request.finished_logits.end(), logits, logits + labels.size());
+                }
+            }
+            PRINT_THREAD_MAIN("Session finished: " << session->get_instance_name() << " for request " << request.request_id << " (" << latency << " ms)");
+        }
+
+        threads_using -= session->get_num_intra_threads() * session->get_num_inter_threads();
+        metrics_registry.set_threads_in_use(threads_using);
+        session_owners[session_idx] = -1;
+        session->set_state(SESSION_STATE_IDLE);
+    }
+}
+
+void InferenceScheduler::launch_stream_sessions() {
+    struct Candidate {
+        int request_pos;
+        int pending_pos;
+        int64_t deadline_ts;
+        float slack_ms;
+    };
+
+
+    update_thermal_state();
+
+    int64_t now_ts = get_current_time();
+    std::vector<Candidate> candidates;
+    for (int r = 0; r < active_requests.size(); r++) {
+        FrameRequest& request = active_requests[r];
+        StreamInfo& stream = streams[request.stream_id];
+
+        for (int p = 0; p < request.pending.size(); ) {
+            int pool_idx = stream.pool_idxs[request.pending[p]];
+            int session_idx = pool_sessions[pool_idx].front();
+            float expected_latency_ms = expected_latency(session_idx);
+            float slack_ms = request.deadline_ts - now_ts - expected_latency_ms;
+
+            // cannot make it anymore, the remaining time only shrinks
+            if (slack_ms < 0) {
+                PRINT_THREAD_MAIN("May exceed deadline: " << sessions[session_idx]->get_instance_name() << " for request " << request.request_id);
+                request.pending.erase(request.pending.begin() + p);
+                continue;
+            }
+            if (find_idle_replica(pool_idx) != -1) {
+                candidates.push_back(Candidate{r, p, request.deadline_ts, slack_ms});
+            }
+            p++;
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.deadline_ts != b.deadline_ts) return a.deadline_ts < b.deadline_ts;
+        return a.slack_ms < b.slack_ms;
+    });
+
+    std::vector<std::pair<int, int>> launched;  // (request_pos, pending_pos)
+    for (auto& candidate : candidates) {
+        FrameRequest& request = active_requests[candidate.request_pos];
+        StreamInfo& stream = streams[request.stream_id];
+        int stream_pool_pos = request.pending[candidate.pending_pos];
+        int session_idx = find_idle_replica(stream.pool_idxs[stream_pool_pos]);
+        if (session_idx == -1) {
+            continue;
+        }
+        InferenceSession* session = sessions[session_idx];
+        int session_num_threads = session->get_num_intra_threads() * session->get_num_inter_threads();
+        if (threads_using + session_num_threads > thread_budget) {
+            continue;
+        }
+
+        session->select_input(stream.input_slots[stream_pool_pos]);
+        session_launch_times[session_idx] = get_current_time();
+        if (session->infer_async() != 0) {
+            PRINT_THREAD_MAIN("Failed to start session: " << session->get_instance_name());
+            continue;
+        }
+
+        PRINT_THREAD_MAIN("Session started: " << session->get_instance_name() << " for request " << request.request_id);
+        threads_using += session_num_threads;
+        metrics_registry.set_threads_in_use(threads_using);
+        session_owners[session_idx] = request.request_id;
+        mark_session_used(session_idx);
+        if (request.first_launch_ts < 0) {
+            request.first_launch_ts = session_launch_times[session_idx];
+        }
+        request.num_launched++;
+        request.num_running++;
+        launched.push_back(std::make_pair(candidate.request_pos, candidate.pending_pos));
+    }
+
+    // drop launched entries from the pending lists, back to front to keep positions valid
+    std::sort(launched.begin(), launched.end(), std::greater<std::pair<int, int>>());
+    for (auto& entry : launched) {
+        std::vector<int>& pending = active_requests[entry.first].pending;
+        pending.erase(pending.begin() + entry.second);
+    }
+}
+
+void InferenceScheduler::close_request(int request_pos) {
+    FrameRequest request = std::move(active_requests[request_pos]);
+    active_requests.erase(active_requests.begin() + request_pos);
+
+    int64_t end_ts = std::min(get_current_time(), request.deadline_ts);
+    push_frame_stats(FrameStats{
+        request.arrival_ts, end_ts, request.deadline_ts,
+        request.num_launched, request.num_finished,
+        request.stream_id, 0
+    });
+
+    // closed-loop streams close requests too, they are not part of a load run
+    if (serving_load) {
+        int outcome = request.num_launched == 0 ? LOAD_OUTCOME_DROPPED : frame_hit(frame_stats.back()) ? LOAD_OUTCOME_HIT : LOAD_OUTCOME_MISS;
+        int64_t queue_end_ts = request.first_launch_ts >= 0 ? request.first_launch_ts : end_ts;
+        int64_t service_end_ts = request.num_running > 0 || request.last_finish_ts < 0 ? end_ts : std::min(request.last_finish_ts, end_ts);
+        load_records.push_back(LoadRecord{
+            request.request_id, request.stream_id, request.arrival_ts,
+            queue_end_ts - request.arrival_ts, request.first_launch_ts >= 0 ? service_end_ts - request.first_launch_ts : 0,
+            end_ts - request.arrival_ts, request.num_launched, request.num_finished, outcome
+        });
+    }
+
+    std::vector<const float*> logits;
+    for (int row = 0; row < request.logit_sessions.size(); row++) {
+        logits.push_back(request.finished_logits.data() + row * labels.size());
+    }
+    postprocess_frame(request.stream_id, request.logit_sessions, logits, std::vector<int>(logits.size(), 0));
+
+    if (result_sink != nullptr) {
+        emit_frame_record(
+            frame_stats.back(), streams[request.stream_id].pool_idxs,
+            request.finished_sessions, request.finished_latencies, std::vector<AgedResult>()
+        );
+    }
+
+    if (verbose) {
+        std::cout << "[" << streams[request.stream_id].name << "] Elapsed time: " << end_ts - request.arrival_ts << " ms, "
+            << request.num_finished << "/" << request.num_launched << " sessions finished" << std::endl;
+        if (!frame_result.ensemble_top_k.empty()) {
+            const Prediction& top = frame_result.ensemble_top_k[0];
+            std::cout << "[" << streams[request.stream_id].name << "] Ensemble prediction: " << labels[top.label_id] << " (" << top.probability << ")" << std::endl;
+        }
+    }
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "session.hpp"
 #include "util.hpp"
 #include "input.hpp"
+#include "simulator.hpp"
+#include "memory.hpp"
+#include "profile_store.hpp"
 
 
 template <typename T>
@@ -25,28 +28,69 @@ static std::ostream& operator<<(std::ostream& os, const std::vector<T>& v)
     return os;
 }
 
-Ort::Session *create_session(const std::string& model_filepath, const std::string& instance_name, int num_intra_threads, int num_inter_threads)
+// Sessions sharing weights must live in the same environment, so a single one is kept for the process.
+Ort::Env& get_ort_env()
+{
+    static Ort::Env env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "raspi-dnn");
+    return env;
+}
+
+Ort::Session *create_session(
+    const std::string& model_filepath, const std::string& instance_name, int num_intra_threads, int num_inter_threads,
+    SessionMemoryManager* memory_manager, const std::string& profile_prefix
+)
 {
-    Ort::Env env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, instance_name.c_str());
     Ort::SessionOptions session_options;
+    // ORT warnings name the session they come from
+    session_options.SetLogId(instance_name.c_str());
     session_options.SetExecutionMode(ExecutionMode::ORT_PARALLEL);
     session_options.SetIntraOpNumThreads(num_intra_threads);
     session_options.SetInterOpNumThreads(num_inter_threads);
     session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+    if (!profile_prefix.empty()) {
+        session_options.EnableProfiling(profile_prefix.c_str());
+    }
 
-    return new Ort::Session(env, model_filepath.c_str(), session_options);
+    if (memory_manager != nullptr) {
+        memory_manager->apply_session_options(session_options);
+        Ort::PrepackedWeightsContainer* prepacked_weights = memory_manager->get_prepacked_weights(model_filepath);
+
+        // model bytes stay mapped, so reloading an evicted session reads from the page cache
+        size_t model_size = 0;
+        const void* model_data = memory_manager->map_model(model_filepath, &model_size);
+        if (model_data != nullptr) {
+            return new Ort::Session(get_ort_env(), model_data, model_size, session_options, *prepacked_weights);
+        }
+        return new Ort::Session(get_ort_env(), model_filepath.c_str(), session_options, *prepacked_weights);
+    }
+    return new Ort::Session(get_ort_env(), model_filepath.c_str(), session_options);
 }
 
 InferenceSession::InferenceSession(
     std::string instance_name,
     const std::string& model_path, const std::string& label_path,
-    int num_intra_threads, int num_inter_threads
-) : instance_name(instance_name), model_path(model_path), label_path(label_path), num_intra_threads(num_intra_threads), num_inter_threads(num_inter_threads)
+    int num_intra_threads, int num_inter_threads,
+    SchedulerSimulator* simulator,
+    SessionMemoryManager* memory_manager,
+    int lazy_load,
+    int num_crops
+) : instance_name(instance_name), model_path(model_path), label_path(label_path), num_intra_threads(num_intra_threads), num_inter_threads(num_inter_threads), num_crops(num_crops), simulator(simulator), memory_manager(memory_manager)
 {
     labels = read_labels(label_path);
-    session = create_session(model_path, instance_name, num_intra_threads, num_inter_threads);
+    if (memory_manager != nullptr) {
+        run_options = Ort::RunOptions();
+        memory_manager->apply_run_options(run_options);
+        shrink_run_options = Ort::RunOptions();
+        memory_manager->apply_run_options(shrink_run_options);
+        shrink_run_options.AddConfigEntry("memory.enable_memory_arena_shrinkage", "cpu:0");
+    }
     state = SESSION_STATE_IDLE;
     std::atomic_store(&flag_infer, 0);
+    std::atomic_store(&load_state, SESSION_LOAD_UNLOADED);
+
+    if (!lazy_load) {
+        load_model(0);
+    }
 }
 
 InferenceSession::~InferenceSession() {
@@ -59,12 +103,118 @@ void InferenceSession::print_info() {
     printf(" - Model Path: %s\n", model_path.c_str());
     printf(" - Label Path: %s\n", label_path.c_str());
     printf(" - Number of (Intra, Inter) Threads: (%d, %d)\n", num_intra_threads, num_inter_threads);
+    printf(" - Number of Crops: %d\n", num_crops);
     printf("\n");
 }
 
+// Creates the ORT session, prepares the recorded inputs and measures a warm run.
+void InferenceSession::load_model(int num_warmup_runs)
+{
+    if (simulator != nullptr || session != nullptr) {
+        std::atomic_store(&load_state, SESSION_LOAD_LOADED);
+        return;
+    }
+
+    // hashed here, on the load thread for lazy loads, so the frame loop finds the hash cached
+    if (profile_store != nullptr) {
+        profile_store->prepare(model_path);
+    }
+
+    int64_t resident_before = get_resident_memory_bytes();
+    session = create_session(model_path, instance_name, num_intra_threads, num_inter_threads, memory_manager, profile_prefix);
+    if (!input_image_path.empty()) {
+        prepare_io();
+
+        for (int i = 0; i < num_warmup_runs; i++) {
+            auto begin = std::chrono::steady_clock::now();
+            session_run();
+            auto end = std::chrono::steady_clock::now();
+            warm_latency_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000.0;
+        }
+    }
+    resident_bytes = get_resident_memory_bytes() - resident_before;
+
+    std::atomic_store(&load_state, SESSION_LOAD_LOADED);
+}
+
+void *load_async_func(void* arg)
+{
+    InferenceSession* session = (InferenceSession*)arg;
+
+    PRINT_THREAD_SUB("Load start: " << session->get_instance_name());
+    session->load_model(SESSION_NUM_WARMUP_RUNS);
+    PRINT_THREAD_SUB("Load end: " << session->get_instance_name() << " (" << session->get_warm_latency() << " ms)");
+
+    // wake the scheduler so the session can still be used in the current frame
+    session->notify_completion();
+    session->leave_worker();
+
+    return nullptr;
+}
+
+int InferenceSession::load_model_async()
+{
+    int expected = SESSION_LOAD_UNLOADED;
+    if (!std::atomic_compare_exchange_strong(&load_state, &expected, SESSION_LOAD_LOADING)) {
+        return -1;
+    }
+
+    pthread_attr_t load_attr;
+    pthread_attr_init(&load_attr);
+    pthread_attr_setdetachstate(&load_attr, PTHREAD_CREATE_DETACHED);
+    enter_worker();
+    int ret = pthread_create(&load_thread, &load_attr, (void* (*)(void*))&load_async_func, this);
+    pthread_attr_destroy(&load_attr);
+
+    if (ret != 0) {
+        leave_worker();
+        std::atomic_store(&load_state, SESSION_LOAD_UNLOADED);
+    }
+    return ret;
+}
+
+// Frees the ORT session and its buffers; the recorded inputs are kept for the next load.
+int InferenceSession::unload_model()
+{
+    if (simulator != nullptr || !is_loaded() || std::atomic_load(&flag_infer) == 1) {
+        return -1;
+    }
+
+    delete session;
+    session = nullptr;
+
+    input_names.clear();
+    output_names.clear();
+    input_tensors.clear();
+    output_tensors.clear();
+    input_node_name_allocated_strings.clear();
+    output_node_name_allocated_strings.clear();
+    std::vector<float>().swap(input_tensor_values);
+    extra_input_tensor_values.clear();
+    input_slot = 0;
+
+    std::atomic_store(&load_state, SESSION_LOAD_UNLOADED);
+    return 0;
+}
+
 void InferenceSession::load_input(const std::string& image_path, int batch_size)
+{
+    input_image_path = image_path;
+    input_batch_size = batch_size;
+
+    // an unloaded session prepares its inputs in load_model()
+    if (simulator != nullptr || session == nullptr) {
+        return;
+    }
+
+    prepare_io();
+}
+
+void InferenceSession::prepare_io()
 {
     Ort::AllocatorWithDefaultOptions allocator;
+    const std::string& image_path = input_image_path;
+    int batch_size = input_batch_size;
 
     size_t num_input_nodes = session->GetInputCount();
     size_t num_output_nodes = session->GetOutputCount();
@@ -72,10 +222,15 @@ void InferenceSession::load_input(const std::string& image_path, int batch_size)
     Ort::TypeInfo input_type_info = session->GetInputTypeInfo(0);
     auto input_tensor_info = input_type_info.GetTensorTypeAndShapeInfo();
     ONNXTensorElementDataType input_type = input_tensor_info.GetElementType();
-    std::vector<int64_t> input_dims = input_tensor_info.GetShape();
+    input_dims = input_tensor_info.GetShape();
     if (input_dims.at(0) == -1)
     {
-        input_dims.at(0) = batch_size;
+        input_dims.at(0) = batch_size * num_crops;
+    }
+    else if (num_crops > 1 && input_dims.at(0) != batch_size * num_crops)
+    {
+        std::cerr << "Model has a fixed batch size, cannot run " << num_crops << " crops: " << model_path << std::endl;
+        exit(1);
     }
 
     Ort::TypeInfo output_type_info = session->GetOutputTypeInfo(0);
@@ -84,16 +239,19 @@ void InferenceSession::load_input(const std::string& image_path, int batch_size)
     std::vector<int64_t> outputDims = output_tensor_info.GetShape();
     if (outputDims.at(0) == -1)
     {
-        outputDims.at(0) = batch_size;
+        outputDims.at(0) = batch_size * num_crops;
     }
 
     size_t inputTensorSize = vector_product(input_dims);
     input_tensor_values.resize(inputTensorSize);
-    prepareInputTensor(image_path, input_dims, input_tensor_values, batch_size, inputTensorSize);
+    fill_input(image_path, input_tensor_values);
 
     size_t outputTensorSize = vector_product(outputDims);
-    assert(("Output tensor size should equal to the label set size.", labels.size() * batch_size == outputTensorSize));
+    assert(("Output tensor size should equal to the label set size.", labels.size() * batch_size * num_crops == outputTensorSize));
     output_tensor_values.resize(outputTensorSize);
+    if (num_crops > 1) {
+        merged_output_values.resize(labels.size() * batch_size);
+    }
 
     auto inputNodesNum = session->GetInputCount();
     for (int i = 0; i < inputNodesNum; i++) {
@@ -113,18 +271,97 @@ void InferenceSession::load_input(const std::string& image_path, int batch_size)
     input_tensors.push_back(Ort::Value::CreateTensor<float>(memoryInfo, input_tensor_values.data(), inputTensorSize, input_dims.data(), input_dims.size()));
     output_tensors.push_back(Ort::Value::CreateTensor<float>(memoryInfo, output_tensor_values.data(), outputTensorSize, outputDims.data(), outputDims.size()));
 
+    for (auto& extra_image_path : extra_input_image_paths) {
+        prepare_extra_input(extra_image_path);
+    }
+}
+
+// Prepares another input image in its own buffer; returns the slot to pass to select_input().
+int InferenceSession::add_input(const std::string& image_path)
+{
+    if (simulator != nullptr) {
+        return 0;
+    }
+
+    extra_input_image_paths.push_back(image_path);
+    if (session == nullptr) {
+        return extra_input_image_paths.size();
+    }
+    return prepare_extra_input(image_path);
+}
+
+int InferenceSession::prepare_extra_input(const std::string& image_path)
+{
+    assert(("load_input() should be called before add_input().", !input_tensors.empty()));
+
+    size_t inputTensorSize = input_tensor_values.size();
+    extra_input_tensor_values.push_back(std::vector<float>(inputTensorSize));
+    std::vector<float>& values = extra_input_tensor_values.back();
+    fill_input(image_path, values);
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    input_tensors.push_back(Ort::Value::CreateTensor<float>(memoryInfo, values.data(), inputTensorSize, input_dims.data(), input_dims.size()));
+
+    return input_tensors.size() - 1;
+}
+
+void InferenceSession::fill_input(const std::string& image_path, std::vector<float>& values)
+{
+    if (num_crops == 1) {
+        prepareInputTensor(image_path, input_dims, values, input_dims.at(0), values.size());
+        return;
+    }
+    prepare_crop_tensor(image_path, input_dims, values, num_crops);
+}
+
+// Averages the logits of each image's crops into merged_output_values, on the run's own thread.
+void InferenceSession::merge_crops()
+{
+    if (num_crops == 1) {
+        return;
+    }
+
+    size_t num_classes = labels.size();
+    float inv_crops = 1.0f / num_crops;
+    for (size_t image = 0; image < merged_output_values.size() / num_classes; image++) {
+        float* merged = merged_output_values.data() + image * num_classes;
+        const float* crop = output_tensor_values.data() + image * num_crops * num_classes;
+        std::copy(crop, crop + num_classes, merged);
+        for (int c = 1; c < num_crops; c++) {
+            crop += num_classes;
+            for (size_t i = 0; i < num_classes; i++) {
+                merged[i] += crop[i];
+            }
+        }
+        for (size_t i = 0; i < num_classes; i++) {
+            merged[i] *= inv_crops;
+        }
+    }
 }
 
 void InferenceSession::print_results()
 {
+    if (simulator != nullptr || session == nullptr) {
+        return;
+    }
+
     output_tensor_values.assign(output_tensors.at(0).GetTensorMutableData<float>(), output_tensors.at(0).GetTensorMutableData<float>() + output_tensors.at(0).GetTensorTypeAndShapeInfo().GetElementCount());
     print_inference_results(output_tensor_values, labels, 1);
 }
 
+// the arena is shrunk at the end of a run, so a shrink requested after an eviction rides on the next one
+Ort::RunOptions& InferenceSession::next_run_options()
+{
+    if (memory_manager != nullptr && memory_manager->consume_arena_shrink()) {
+        return shrink_run_options;
+    }
+    return run_options;
+}
+
 void InferenceSession::session_run()
 {
-    Ort::RunOptions run_options{nullptr};
-    session->Run(run_options, input_names.data(), input_tensors.data(), 1, output_names.data(), output_tensors.data(), 1);
+    session->Run(next_run_options(), input_names.data(), &input_tensors.at(input_slot), 1, output_names.data(), output_tensors.data(), 1);
+    merge_crops();
 }
 
 void InferenceSession::infer_sync()
@@ -136,13 +373,19 @@ void InferenceSession::infer_sync()
         return;
     }
 
+    if (simulator != nullptr) {
+        simulator->advance_to(simulator->launch(this));
+        return;
+    }
+
     state = SESSION_STATE_INFER;
 
     session->Run(
-        Ort::RunOptions{nullptr}, 
-        input_names.data(), input_tensors.data(), 1, 
+        next_run_options(), 
+        input_names.data(), &input_tensors.at(input_slot), 1, 
         output_names.data(), output_tensors.data(), 1
     );
+    merge_crops();
 
     finish_time_ts = get_current_time_milliseconds();
 
@@ -169,18 +412,25 @@ void *infer_async_func(void* arg)
     {
         PRINT_THREAD_SUB("Inference canceled: " << session->get_instance_name());
         
+        session->record_run_end(finish_time_ts, 1);
         session->set_state(SESSION_STATE_ZOMBIE);
         session->set_flag_infer(0);
+
+        // the session is usable again, which may let the scheduler start it
+        session->notify_completion();
+        session->leave_worker();
         return nullptr;
     }
 
-    // Notify finish listeners
+    session->record_run_end(finish_time_ts, 0);
     session->set_state(SESSION_STATE_FINISHED);
-    session->notify_finish_listeners();
+    session->set_flag_infer(0);
 
     PRINT_THREAD_SUB("Inference end: " << session->get_instance_name());
 
-    session->set_flag_infer(0);
+    // last, so the scheduler never sees a completion before the session state
+    session->notify_completion();
+    session->leave_worker();
     return nullptr;
 }
 
@@ -192,10 +442,23 @@ int InferenceSession::infer_async()
         return -1;
     }
 
+    metrics.num_launches.fetch_add(1, std::memory_order_relaxed);
+
+    if (simulator != nullptr) {
+        launch_time_ts = simulator->get_current_time();
+        simulator->launch(this);
+        return 0;
+    }
+
+    launch_time_ts = get_current_time_milliseconds();
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
+    enter_worker();
     ret = pthread_create(&thread, &attr, (void* (*)(void*))&infer_async_func, this);
+    if (ret != 0) {
+        leave_worker();
+    }
 
     return ret;
 }
@@ -211,30 +474,70 @@ void InferenceSession::wait_infer()
     while (std::atomic_load(&flag_infer) == 1) { }
 }
 
-void InferenceSession::add_finish_listener(pthread_mutex_t* mutex, pthread_cond_t* cond)
+// ORT writes <prefix>_<timestamp>.json; only takes effect if called before the model is loaded.
+void InferenceSession::enable_profiling(const std::string& profile_prefix)
 {
-    finish_listeners_mutex.push_back(mutex);
-    finish_listeners_cond.push_back(cond);
+    this->profile_prefix = profile_prefix;
 }
 
-void InferenceSession::notify_finish_listeners()
+// Stops profiling and returns the trace path, empty if the session was not profiled.
+// Later loads of the model (after an eviction) are not profiled again.
+std::string InferenceSession::end_profiling()
 {
-    for (int i = 0; i < finish_listeners_mutex.size(); i++)
-    {
-        pthread_mutex_lock(finish_listeners_mutex[i]);
-        PRINT_THREAD_SUB("Notifying finish listener: " << instance_name);
-        pthread_cond_signal(finish_listeners_cond[i]);
-        pthread_mutex_unlock(finish_listeners_mutex[i]);
+    if (profile_prefix.empty() || session == nullptr) {
+        profile_prefix.clear();
+        return "";
+    }
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    Ort::AllocatedStringPtr trace_path = session->EndProfilingAllocated(allocator);
+    profile_prefix.clear();
+    return trace_path.get();
+}
+
+void InferenceSession::attach_completion_signal(CompletionSignal* completion_signal, int completion_slot)
+{
+    this->completion_signal = completion_signal;
+    this->completion_slot = completion_slot;
+}
+
+void InferenceSession::notify_completion()
+{
+    if (completion_signal != nullptr) {
+        PRINT_THREAD_SUB("Posting completion: " << instance_name);
+        completion_signal->post(completion_slot);
     }
 }
 
 void InferenceSession::reset_state()
 {
+    if (std::atomic_load(&flag_infer) == 1 && state == SESSION_STATE_INFER) {
+        metrics.num_cancellations.fetch_add(1, std::memory_order_relaxed);
+    }
     num_inferenced++;
     finish_time_ts = get_current_time_milliseconds();
     state = SESSION_STATE_IDLE;
 }
 
+void InferenceSession::record_run_end(int64_t finish_time_ts, int canceled)
+{
+    if (launch_time_ts < 0) {
+        return;
+    }
+
+    int64_t latency_ms = finish_time_ts - launch_time_ts;
+    launch_time_ts = -1;
+
+    if (canceled) {
+        metrics.num_zombies.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        metrics.num_finishes.fetch_add(1, std::memory_order_relaxed);
+    }
+    metrics.busy_thread_ms.fetch_add(latency_ms * num_intra_threads * num_inter_threads, std::memory_order_relaxed);
+    metrics.latency_ms.record(latency_ms);
+}
+
 void test_single_session(
     const std::string& model_filepath, const std::string& label_filepath, const std::string& image_filepath,
     int num_intra_threads, int num_inter_threads,
@@ -0,0 +1,202 @@
+#include "simulator.hpp"
+#include "session.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <numeric>
+
+
+LatencyModel::LatencyModel(const std::vector<float>& samples) : samples(samples) {
+    mean_ms = std::accumulate(samples.begin(), samples.end(), 0.0f) / samples.size();
+}
+
+LatencyModel::LatencyModel(float mean_ms, float stddev_ms) : mean_ms(mean_ms), stddev_ms(stddev_ms) { }
+
+float LatencyModel::sample(std::mt19937& rng) {
+    if (!samples.empty()) {
+        float latency = samples[cursor];
+        cursor = (cursor + 1) % samples.size();
+        return latency;
+    }
+
+    std::normal_distribution<float> dist(mean_ms, stddev_ms);
+    return std::max(dist(rng), 0.0f);
+}
+
+float LatencyModel::expected() {
+    return mean_ms;
+}
+
+LatencyModel LatencyModel::scaled(float factor) {
+    if (!samples.empty()) {
+        std::vector<float> scaled_samples(samples);
+        for (auto& sample : scaled_samples) {
+            sample *= factor;
+        }
+        return LatencyModel(scaled_samples);
+    }
+    return LatencyModel(mean_ms * factor, stddev_ms * factor);
+}
+
+std::string latency_model_key(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops) {
+    std::string key = model_path + " " + std::to_string(num_intra_threads) + " " + std::to_string(num_inter_threads);
+    if (num_crops > 1) {
+        key += " crops=" + std::to_string(num_crops);
+    }
+    return key;
+}
+
+
+SchedulerSimulator::SchedulerSimulator(const std::string& trace_path, unsigned int seed) : rng(seed) {
+    load_trace(trace_path);
+}
+
+SchedulerSimulator::~SchedulerSimulator() { }
+
+void SchedulerSimulator::load_trace(const std::string& trace_path) {
+    std::ifstream trace_file(trace_path);
+    if (!trace_file.is_open()) {
+        std::cerr << "Failed to open latency trace: " << trace_path << std::endl;
+        exit(1);
+    }
+
+    // <model_path> <num_intra> <num_inter> [crops=<n>] <latency_ms>...     (recorded, replayed in order)
+    // <model_path> <num_intra> <num_inter> [crops=<n>] ~ <mean_ms> <stddev_ms>  (modeled)
+    std::string line;
+    while (std::getline(trace_file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream iss(line);
+        std::string model_path;
+        int num_intra_threads, num_inter_threads;
+        iss >> model_path >> num_intra_threads >> num_inter_threads;
+
+        int num_crops = 1;
+        std::string token;
+        std::vector<float> samples;
+        while (iss >> token) {
+            if (token.compare(0, 6, "crops=") == 0) {
+                num_crops = std::max(std::stoi(token.substr(6)), 1);
+                continue;
+            }
+            std::string key = latency_model_key(model_path, num_intra_threads, num_inter_threads, num_crops);
+            if (token == "~") {
+                float mean_ms = 0, stddev_ms = 0;
+                iss >> mean_ms >> stddev_ms;
+                latency_models[key] = LatencyModel(mean_ms, stddev_ms);
+                break;
+            }
+            samples.push_back(std::stof(token));
+        }
+        if (!samples.empty()) {
+            latency_models[latency_model_key(model_path, num_intra_threads, num_inter_threads, num_crops)] = LatencyModel(samples);
+        }
+    }
+}
+
+LatencyModel& SchedulerSimulator::find_latency_model(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops) {
+    std::string key = latency_model_key(model_path, num_intra_threads, num_inter_threads, num_crops);
+    auto it = latency_models.find(key);
+    if (it != latency_models.end()) {
+        return it->second;
+    }
+
+    // untraced crop counts run the single-crop latency once per crop, as a batch costs about that on CPU
+    if (num_crops > 1) {
+        LatencyModel& single = find_latency_model(model_path, num_intra_threads, num_inter_threads, 1);
+        return latency_models[key] = single.scaled(num_crops);
+    }
+
+    // fall back to any thread config of the same model
+    for (auto& entry : latency_models) {
+        if (
+            entry.first.compare(0, model_path.size() + 1, model_path + " ") == 0
+             && entry.first.find(" crops=") == std::string::npos
+        ) {
+            return entry.second;
+        }
+    }
+
+    std::cerr << "No latency trace for model: " << model_path << std::endl;
+    exit(1);
+}
+
+float SchedulerSimulator::get_expected_latency(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops) {
+    return find_latency_model(model_path, num_intra_threads, num_inter_threads, num_crops).expected();
+}
+
+int SchedulerSimulator::has_latency_model(const std::string& model_path, int num_intra_threads, int num_inter_threads, int num_crops) {
+    return latency_models.count(latency_model_key(model_path, num_intra_threads, num_inter_threads, num_crops)) > 0;
+}
+
+int64_t SchedulerSimulator::launch(InferenceSession* session) {
+    LatencyModel& model = find_latency_model(
+        session->get_model_path(), session->get_num_intra_threads(), session->get_num_inter_threads(),
+        session->get_num_crops()
+    );
+    int64_t latency_ms = (int64_t)std::lround(model.sample(rng));
+
+    session->set_state(SESSION_STATE_INFER);
+    events.push(FinishEvent{now_ts + latency_ms, next_seq++, session, session->get_num_inferenced()});
+    pending_events[session]++;
+
+    PRINT_THREAD_SUB("Inference start: " << session->get_instance_name() << " (simulated " << latency_ms << " ms)");
+    return now_ts + latency_ms;
+}
+
+// Mirrors the tail of infer_async_func(); returns 1 when it would post a completion, which a
+// canceled run does too, since freeing its threads may let the scheduler launch another session.
+int SchedulerSimulator::process_event(const FinishEvent& event) {
+    InferenceSession* session = event.session;
+    if (--pending_events[session] == 0) {
+        pending_events.erase(session);
+    }
+    session->set_finish_time(event.finish_ts);
+
+    if (event.inference_id != session->get_num_inferenced()) {
+        PRINT_THREAD_SUB("Inference canceled: " << session->get_instance_name());
+
+        session->record_run_end(event.finish_ts, 1);
+        session->set_state(SESSION_STATE_ZOMBIE);
+        session->set_flag_infer(0);
+        return 1;
+    }
+
+    session->record_run_end(event.finish_ts, 0);
+    session->set_state(SESSION_STATE_FINISHED);
+    session->set_flag_infer(0);
+
+    PRINT_THREAD_SUB("Inference end: " << session->get_instance_name());
+    return 1;
+}
+
+void SchedulerSimulator::advance_to(int64_t timestamp) {
+    while (!events.empty() && events.top().finish_ts <= timestamp) {
+        FinishEvent event = events.top();
+        events.pop();
+        now_ts = event.finish_ts;
+        process_event(event);
+    }
+
+    now_ts = std::max(now_ts, timestamp);
+}
+
+// Virtual-clock counterpart of pthread_cond_timedwait() on the scheduler's finish condition.
+int SchedulerSimulator::wait_any_finished(int64_t deadline_ts) {
+    while (!events.empty() && events.top().finish_ts <= deadline_ts) {
+        FinishEvent event = events.top();
+        events.pop();
+        now_ts = std::max(now_ts, event.finish_ts);
+
+        if (process_event(event)) {
+            advance_to(now_ts);
+            return 0;
+        }
+    }
+
+    now_ts = std::max(now_ts, deadline_ts);
+    return ETIMEDOUT;
+}
@@ -0,0 +1,201 @@
+#include "thermal.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+
+// Sorted names in dir starting with prefix.
+static std::vector<std::string> list_entries(const std::string& dir_path, const std::string& prefix) {
+    std::vector<std::string> names;
+    DIR* dir = opendir(dir_path.c_str());
+    if (dir == nullptr) {
+        return names;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0) {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static std::string read_line(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// A policy runs the sessions if one of its CPUs is in the affinity mask; without the
+// CPU list or the mask, every policy is assumed to.
+static int policy_in_affinity(const std::string& policy_dir) {
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    std::string cpus = read_line(policy_dir + "/related_cpus");
+    if (cpus.empty() || sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+        return 1;
+    }
+
+    std::istringstream iss(cpus);
+    int cpu;
+    while (iss >> cpu) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &mask)) {
+            return 1;
+        }
+    }
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+
+ThermalMonitor::ThermalMonitor(const std::string& sysfs_root) {
+    // one cpufreq policy per cluster; older kernels only have the per-cpu directories
+    std::string cpufreq_dir = sysfs_root + "/devices/system/cpu/cpufreq";
+    std::vector<std::string> policy_dirs;
+    for (auto& name : list_entries(cpufreq_dir, "policy")) {
+        policy_dirs.push_back(cpufreq_dir + "/" + name);
+    }
+    if (policy_dirs.empty()) {
+        policy_dirs.push_back(sysfs_root + "/devices/system/cpu/cpu0/cpufreq");
+    }
+
+    for (auto& policy_dir : policy_dirs) {
+        if (!policy_in_affinity(policy_dir)) {
+            PRINT_THREAD_MAIN("Cpufreq policy skipped, outside the affinity mask: " << policy_dir);
+            continue;
+        }
+        int fd = open((policy_dir + "/scaling_max_freq").c_str(), O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        policy_fds.push_back(fd);
+        reference_freqs.push_back(read_value(fd));
+    }
+
+    std::string thermal_dir = sysfs_root + "/class/thermal";
+    for (auto& name : list_entries(thermal_dir, "thermal_zone")) {
+        if (zone_fds.size() >= THERMAL_MAX_ZONES) {
+            break;
+        }
+
+        std::string zone_dir = thermal_dir + "/" + name;
+        int fd = open((zone_dir + "/temp").c_str(), O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+
+        // the first passive trip is where the kernel starts to throttle
+        int64_t trip_mc = -1;
+        for (int trip = 0; ; trip++) {
+            std::string trip_prefix = zone_dir + "/trip_point_" + std::to_string(trip);
+            std::string trip_type = read_line(trip_prefix + "_type");
+            if (trip_type.empty()) {
+                break;
+            }
+            int64_t trip_temp_mc = atoll(read_line(trip_prefix + "_temp").c_str());
+            if (trip_type == "passive" && (trip_mc < 0 || trip_temp_mc < trip_mc)) {
+                trip_mc = trip_temp_mc;
+            }
+        }
+        if (trip_mc < 0) {
+            trip_mc = (int64_t)(THERMAL_DEFAULT_TRIP_C * 1000);
+        }
+
+        zone_fds.push_back(fd);
+        zone_trips.push_back(trip_mc);
+        PRINT_THREAD_MAIN("Thermal zone " << name << ": trip " << trip_mc / 1000.0 << " C");
+    }
+}
+
+ThermalMonitor::~ThermalMonitor() {
+    for (auto fd : policy_fds) {
+        close(fd);
+    }
+    for (auto fd : zone_fds) {
+        close(fd);
+    }
+}
+
+// sysfs attributes must be read from offset 0 to get a fresh value
+int64_t ThermalMonitor::read_value(int fd) {
+    char buffer[32];
+    ssize_t num_read = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (num_read <= 0) {
+        return -1;
+    }
+    buffer[num_read] = '\0';
+    return atoll(buffer);
+}
+
+void ThermalMonitor::mark_reference() {
+    for (int i = 0; i < policy_fds.size(); i++) {
+        int64_t freq_khz = read_value(policy_fds[i]);
+        if (freq_khz > 0) {
+            reference_freqs[i] = freq_khz;
+        }
+    }
+}
+
+void ThermalMonitor::set_reference(const std::vector<int64_t>& freqs_khz) {
+    if (freqs_khz.size() != policy_fds.size()) {
+        mark_reference();
+        return;
+    }
+    for (int i = 0; i < policy_fds.size(); i++) {
+        if (freqs_khz[i] > 0) {
+            reference_freqs[i] = freqs_khz[i];
+        }
+    }
+}
+
+std::vector<int64_t> ThermalMonitor::read_freqs() {
+    std::vector<int64_t> freqs_khz;
+    for (auto fd : policy_fds) {
+        freqs_khz.push_back(read_value(fd));
+    }
+    return freqs_khz;
+}
+
+ThermalState ThermalMonitor::sample() {
+    ThermalState state{1.0, 0.0, 1e9};
+
+    double freq_scale = 0.0;
+    for (int i = 0; i < policy_fds.size(); i++) {
+        int64_t freq_khz = read_value(policy_fds[i]);
+        if (freq_khz > 0 && reference_freqs[i] > 0) {
+            freq_scale = std::max(freq_scale, (double)reference_freqs[i] / freq_khz);
+        }
+    }
+    if (freq_scale > 0.0) {
+        state.freq_scale = freq_scale;
+    }
+
+    for (int i = 0; i < zone_fds.size(); i++) {
+        int64_t temp_mc = read_value(zone_fds[i]);
+        if (temp_mc < 0) {
+            continue;
+        }
+        state.temp_c = std::max(state.temp_c, temp_mc / 1000.0);
+        state.headroom_c = std::min(state.headroom_c, (zone_trips[i] - temp_mc) / 1000.0);
+    }
+
+    return state;
+}
@@ -0,0 +1,390 @@
+#include "tuner.hpp"
+#include "scheduler.hpp"
+#include "session.hpp"
+#include "simulator.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+
+EnsembleTuner::EnsembleTuner(const std::string& label_path, int max_threads, unsigned int seed)
+    : label_path(label_path), max_threads(max_threads), seed(seed) { }
+
+// "# ./model/x.onnx (71.40%, 6 ms)" -> 71.40; model lines without the comment are not candidates
+int EnsembleTuner::load_accuracies(const std::string& config_path) {
+    std::ifstream config_file(config_path);
+    if (!config_file.is_open()) {
+        std::cerr << "Failed to open config file: " << config_path << std::endl;
+        return -1;
+    }
+
+    std::string line;
+    while (std::getline(config_file, line)) {
+        if (line.empty() || line[0] != '#') {
+            continue;
+        }
+
+        std::istringstream iss(line.substr(1));
+        std::string model_path, accuracy_token;
+        iss >> model_path >> accuracy_token;
+        size_t ext_pos = model_path.rfind(".onnx");
+        if (ext_pos == std::string::npos || ext_pos + 5 != model_path.size()) {
+            continue;
+        }
+        if (accuracy_token.size() < 3 || accuracy_token[0] != '(' || accuracy_token.find('%') == std::string::npos) {
+            continue;
+        }
+
+        if (accuracies.find(model_path) == accuracies.end()) {
+            model_paths.push_back(model_path);
+        }
+        accuracies[model_path] = atof(accuracy_token.c_str() + 1);
+    }
+
+    printf(" - Candidate models: %d\n", (int)model_paths.size());
+    return model_paths.empty() ? -1 : 0;
+}
+
+// Runs every candidate at power-of-two thread widths and records the latencies as a trace.
+void EnsembleTuner::profile(const std::string& image_path, const std::string& trace_path, int num_runs) {
+    this->image_path = image_path;
+    std::ofstream trace_file(trace_path);
+    if (!trace_file.is_open()) {
+        std::cerr << "Failed to open latency trace: " << trace_path << std::endl;
+        exit(1);
+    }
+    trace_file << "# model_path num_intra num_inter latency_ms..." << std::endl;
+
+    std::cout << "Profiling candidates" << std::endl;
+    for (auto& model_path : model_paths) {
+        if (!std::ifstream(model_path).good()) {
+            std::cout << model_path << " (missing, skipped)" << std::endl;
+            continue;
+        }
+
+        for (int width = 1; width <= max_threads; width *= 2) {
+            std::string instance_name = "tune_" + std::to_string(width) + "_" + model_path;
+            InferenceSession* session = new InferenceSession(instance_name, model_path, label_path, width, 1);
+            session->load_input(image_path, 1);
+            for (int i = 0; i < SESSION_NUM_WARMUP_RUNS; i++) {
+                session->infer_sync();
+            }
+
+            std::vector<float> latencies;
+            for (int i = 0; i < num_runs; i++) {
+                auto begin = std::chrono::steady_clock::now();
+                session->infer_sync();
+                auto end = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000.0);
+            }
+            session->unload_model();
+            delete session;
+
+            char sample[32];
+            trace_file << model_path << " " << width << " 1";
+            for (auto latency : latencies) {
+                snprintf(sample, sizeof(sample), " %.1f", latency);
+                trace_file << sample;
+            }
+            trace_file << std::endl;
+
+            float mean_ms = std::accumulate(latencies.begin(), latencies.end(), 0.0f) / std::max((int)latencies.size(), 1);
+            std::cout << instance_name << " (" << mean_ms << " ms)" << std::endl;
+        }
+    }
+    trace_file.close();
+
+    use_trace(trace_path);
+}
+
+void EnsembleTuner::use_trace(const std::string& trace_path) {
+    this->trace_path = trace_path;
+
+    SchedulerSimulator simulator(trace_path, seed);
+    candidates.clear();
+    for (auto& model_path : model_paths) {
+        for (int width = 1; width <= max_threads; width *= 2) {
+            if (!simulator.has_latency_model(model_path, width, 1)) {
+                continue;
+            }
+            candidates.push_back(TuneCandidate{
+                model_path, accuracies[model_path], width, 1,
+                simulator.get_expected_latency(model_path, width, 1)
+            });
+        }
+    }
+    printf(" - Latency trace: %s (%d model/thread pairs)\n", trace_path.c_str(), (int)candidates.size());
+}
+
+// Drops candidates that cannot meet the deadline and those dominated by another candidate
+// that is at least as accurate, as fast and as narrow.
+void EnsembleTuner::prune_candidates() {
+    front.clear();
+    for (auto& c : candidates) {
+        if (c.latency_ms > deadline_ms) {
+            continue;
+        }
+
+        int dominated = 0;
+        for (auto& other : candidates) {
+            int other_threads = other.num_intra_threads * other.num_inter_threads;
+            int c_threads = c.num_intra_threads * c.num_inter_threads;
+            if (
+                other.accuracy >= c.accuracy && other.latency_ms <= c.latency_ms && other_threads <= c_threads
+                 && (other.accuracy > c.accuracy || other.latency_ms < c.latency_ms || other_threads < c_threads)
+            ) {
+                dominated = 1;
+                break;
+            }
+        }
+        if (!dominated) {
+            front.push_back(c);
+        }
+    }
+
+    printf("<Pareto Front>\n");
+    for (auto& c : front) {
+        printf(" - %s (%.2f%%, %d threads, %.1f ms)\n", c.model_path.c_str(), c.accuracy, c.num_intra_threads * c.num_inter_threads, c.latency_ms);
+    }
+}
+
+// Serves num_frames frames of the members as main() serves frames, on the simulator if one is
+// given and on the real models otherwise.
+TuneResult EnsembleTuner::serve(const std::vector<TuneCandidate>& members, SchedulerSimulator* simulator, int num_frames) {
+    InferenceScheduler scheduler(label_path, max_threads);
+    if (simulator != nullptr) {
+        scheduler.attach_simulator(simulator);
+    }
+    scheduler.set_verbose(0);
+
+    // the benchmark reports every session; hundreds of simulations would drown the search
+    std::ostringstream quiet;
+    std::streambuf* cout_buffer = std::cout.rdbuf(quiet.rdbuf());
+    for (auto& member : members) {
+        scheduler.add_session(member.model_path, 1.0, member.num_intra_threads, member.num_inter_threads);
+    }
+    scheduler.enqueue_inference_naive();
+    if (simulator != nullptr) {
+        scheduler.benchmark(1, 0);
+    }
+    else {
+        scheduler.load_input(image_path, 1);
+        scheduler.benchmark(TUNE_NUM_VALIDATION_RUNS, SESSION_NUM_WARMUP_RUNS);
+    }
+    std::cout.rdbuf(cout_buffer);
+
+    double total_accuracy = 0.0;
+    int64_t total_thread_ms = 0;
+    int64_t start_ts = scheduler.get_current_time();
+    for (int i = 0; i < num_frames; i++) {
+        scheduler.reset_inference();
+        scheduler.sleep_until(start_ts + deadline_ms * i);
+        scheduler.infer(scheduler.get_current_time() + deadline_ms);
+
+        // one replica per member, so session indices are member indices
+        std::vector<int> finished = scheduler.get_finished_sessions();
+        float best_accuracy = 0.0;
+        for (auto session_idx : finished) {
+            const TuneCandidate& member = members[session_idx];
+            best_accuracy = std::max(best_accuracy, member.accuracy);
+            total_thread_ms += (int64_t)(member.latency_ms * member.num_intra_threads * member.num_inter_threads);
+        }
+        if (!finished.empty()) {
+            total_accuracy += best_accuracy + ensemble_gain * (finished.size() - 1);
+        }
+    }
+
+    int num_hits = 0;
+    for (auto& stats : scheduler.get_frame_stats()) {
+        num_hits += stats.num_finished > 0 && stats.num_finished == stats.num_launched;
+    }
+
+    // the scheduler does not own its sessions. Runs that overran the last deadline are still
+    // executing and post to this scheduler's completion signal, so they finish before teardown.
+    for (auto session : scheduler.get_sessions()) {
+        if (session == nullptr) {
+            continue;
+        }
+        while (session->has_workers()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        session->unload_model();
+        delete session;
+    }
+
+    return TuneResult{
+        std::min(total_accuracy / num_frames, 100.0),
+        100.0 * num_hits / num_frames,
+        total_thread_ms / num_frames
+    };
+}
+
+TuneResult EnsembleTuner::simulate(const std::vector<TuneCandidate>& members) {
+    SchedulerSimulator simulator(trace_path, seed);
+    return serve(members, &simulator, TUNE_NUM_FRAMES);
+}
+
+// a is feasible and more accurate than b, or as accurate for less thread time
+int EnsembleTuner::better(const TuneResult& a, const TuneResult& b) {
+    if (a.hit_rate < target_hit_rate) {
+        return 0;
+    }
+    if (b.hit_rate < target_hit_rate) {
+        return 1;
+    }
+    if (std::fabs(a.accuracy - b.accuracy) > 1e-9) {
+        return a.accuracy > b.accuracy;
+    }
+    return a.thread_ms < b.thread_ms;
+}
+
+void EnsembleTuner::search(int64_t deadline_ms, double target_hit_rate, double ensemble_gain) {
+    this->deadline_ms = deadline_ms;
+    this->target_hit_rate = target_hit_rate;
+    this->ensemble_gain = ensemble_gain;
+
+    prune_candidates();
+    ensemble.clear();
+    result = TuneResult{0.0, 0.0, 0};
+    step_ensembles.clear();
+    step_results.clear();
+    validated = 0;
+
+    printf("<Ensemble Search>\n");
+    while (true) {
+        // moves: add a model that is not a member, or run a member at another width
+        std::vector<TuneCandidate> best_members;
+        TuneResult best_result{0.0, 0.0, 0};
+        for (auto& c : front) {
+            std::vector<TuneCandidate> members = ensemble;
+            auto member = std::find_if(members.begin(), members.end(), [&](const TuneCandidate& m) {
+                return m.model_path == c.model_path;
+            });
+            if (member == members.end()) {
+                members.push_back(c);
+            }
+            else if (member->num_intra_threads != c.num_intra_threads || member->num_inter_threads != c.num_inter_threads) {
+                *member = c;
+            }
+            else {
+                continue;
+            }
+
+            TuneResult moved = simulate(members);
+            if (better(moved, best_result)) {
+                best_members = members;
+                best_result = moved;
+            }
+        }
+
+        if (best_members.empty() || best_result.accuracy < result.accuracy + TUNE_MIN_GAIN) {
+            break;
+        }
+        ensemble = best_members;
+        result = best_result;
+        step_ensembles.push_back(ensemble);
+        step_results.push_back(result);
+        printf(
+            " - %d model(s): %.2f%% expected accuracy, %.2f%% hit rate\n",
+            (int)ensemble.size(), result.accuracy, result.hit_rate
+        );
+    }
+
+    if (ensemble.empty()) {
+        printf(" - No ensemble reaches a %.2f%% hit rate\n", target_hit_rate);
+        return;
+    }
+    for (auto& member : ensemble) {
+        printf(" - %s (%d, %d threads, %.1f ms)\n", member.model_path.c_str(), member.num_intra_threads, member.num_inter_threads, member.latency_ms);
+    }
+}
+
+// Serves the chosen ensemble on the real models, where the members contend for cores, caches and
+// memory bandwidth as the simulator does not model. On a miss the ensemble backs off to the
+// previous search step. Without profiling on this machine there are no real models to serve.
+void EnsembleTuner::validate() {
+    if (image_path.empty() || ensemble.empty()) {
+        return;
+    }
+
+    printf("<Ensemble Validation>\n");
+    while (!step_ensembles.empty()) {
+        ensemble = step_ensembles.back();
+        result = step_results.back();
+        measured = serve(ensemble, nullptr, TUNE_NUM_VALIDATION_FRAMES);
+        printf(
+            " - %d model(s): %.2f%% measured hit rate (%.2f%% simulated)\n",
+            (int)ensemble.size(), measured.hit_rate, result.hit_rate
+        );
+        if (measured.hit_rate >= target_hit_rate) {
+            validated = 1;
+            return;
+        }
+        step_ensembles.pop_back();
+        step_results.pop_back();
+    }
+
+    ensemble.clear();
+    printf(" - No ensemble reaches a %.2f%% hit rate on the real models\n", target_hit_rate);
+}
+
+// Writes the ensemble as a config, with the accuracy comments so that it can be tuned again.
+int EnsembleTuner::write_config(const std::string& output_path, int64_t deadline_ms, int num_tests) {
+    if (ensemble.empty()) {
+        return -1;
+    }
+
+    std::ofstream output_file(output_path);
+    if (!output_file.is_open()) {
+        std::cerr << "Failed to open tuned config: " << output_path << std::endl;
+        return -1;
+    }
+
+    char line[512];
+    output_file << "!DEADLINE_MS " << deadline_ms << std::endl;
+    output_file << "!NUM_TESTS " << num_tests << std::endl;
+    output_file << std::endl;
+
+    output_file << "# CANDIDATES (single-thread latency from " << trace_path << ")" << std::endl;
+    for (auto& model_path : model_paths) {
+        auto single = std::find_if(candidates.begin(), candidates.end(), [&](const TuneCandidate& c) {
+            return c.model_path == model_path && c.num_intra_threads * c.num_inter_threads == 1;
+        });
+        if (single != candidates.end()) {
+            snprintf(line, sizeof(line), "# %s (%.2f%%, %d ms)", model_path.c_str(), accuracies[model_path], (int)std::lround(single->latency_ms));
+        }
+        else {
+            snprintf(line, sizeof(line), "# %s (%.2f%%)", model_path.c_str(), accuracies[model_path]);
+        }
+        output_file << line << std::endl;
+    }
+    output_file << std::endl;
+
+    snprintf(line, sizeof(line), "# AUTO-TUNED, %ld MS, %.2f%% HIT RATE TARGET", (long)deadline_ms, target_hit_rate);
+    output_file << line << std::endl;
+    snprintf(
+        line, sizeof(line), "# simulated without co-run contention: %.2f%% expected accuracy, %.2f%% hit rate",
+        result.accuracy, result.hit_rate
+    );
+    output_file << line << std::endl;
+    if (validated) {
+        snprintf(line, sizeof(line), "# measured: %.2f%% hit rate over %d frames", measured.hit_rate, TUNE_NUM_VALIDATION_FRAMES);
+    }
+    else {
+        snprintf(line, sizeof(line), "# not validated on real frames, the hit rate is an estimate");
+    }
+    output_file << line << std::endl;
+    for (auto& member : ensemble) {
+        output_file << member.model_path << " 1.0 " << member.num_intra_threads << " " << member.num_inter_threads << std::endl;
+    }
+
+    printf(" - Tuned config: %s\n", output_path.c_str());
+    return 0;
+}
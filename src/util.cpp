@@ -1,4 +1,13 @@
 #include "util.hpp"
+#include "postprocess.hpp"
+
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 std::ostream& operator<<(std::ostream& os, const ONNXTensorElementDataType& type)
 {
@@ -77,26 +86,21 @@ std::vector<std::string> read_labels(const std::string& label_filepath)
 
 void print_inference_results(const std::vector<float>& output_tensor_values, const std::vector<std::string>& labels, int batch_size)
 {
+    int num_classes = labels.size();
+    assert(("Output tensor size should cover the batch.", output_tensor_values.size() >= (size_t)num_classes * batch_size));
+
     std::vector<int> pred_ids(batch_size, 0);
     std::vector<std::string> pred_labels(batch_size);
     std::vector<float> confidences(batch_size, 0.0f);
+    std::vector<float> probs(num_classes);
+    std::vector<Prediction> top_1;
     for (int64_t b = 0; b < batch_size; ++b)
     {
-        float activation = 0;
-        float max_activation = std::numeric_limits<float>::lowest();
-        float exp_sum = 0;
-        for (int i = 0; i < labels.size(); i++)
-        {
-            activation = output_tensor_values.at(i + b * labels.size());
-            exp_sum += std::exp(activation);
-            if (activation > max_activation)
-            {
-                pred_ids.at(b) = i;
-                max_activation = activation;
-            }
-        }
-        pred_labels.at(b) = labels.at(pred_ids.at(b));
-        confidences.at(b) = std::exp(max_activation) / exp_sum;
+        softmax_stable(output_tensor_values.data() + b * num_classes, probs.data(), num_classes);
+        select_top_k(probs.data(), num_classes, 1, top_1);
+        pred_ids[b] = top_1[0].label_id;
+        pred_labels[b] = labels[pred_ids[b]];
+        confidences[b] = top_1[0].probability;
     }
     for (int64_t b = 0; b < batch_size; ++b)
     {
@@ -118,4 +122,27 @@ struct timespec timepoint_to_timespec(int64_t timepoint) {
 int64_t get_current_time_milliseconds() {
     auto now = std::chrono::system_clock::now();
     return std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
-}
\ No newline at end of file
+}
+
+int64_t get_resident_memory_bytes() {
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+#else
+    int64_t size_pages = 0, resident_pages = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> size_pages >> resident_pages;
+    return resident_pages * sysconf(_SC_PAGESIZE);
+#endif
+}
+// Returns freed heap pages to the kernel, so that the resident size reflects what was released.
+// glibc keeps them otherwise; other allocators release on their own.
+void release_free_heap() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}